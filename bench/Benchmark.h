@@ -0,0 +1,100 @@
+/*
+ * Benchmark.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_BENCHMARK_H_
+#define OVERKIZ_BENCHMARK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+namespace Benchmark
+{
+
+  /**
+   * State of one benchmark run.
+   * The clock runs while the benchmark function is called, pause() and
+   * resume() exclude setup and teardown from the measure.
+   */
+  class State
+  {
+  public:
+
+    State(size_t iterations, long argument);
+
+    /**
+     * Stop the clock.
+     */
+    void pause();
+
+    /**
+     * Restart the clock.
+     */
+    void resume();
+
+    /**
+     * Get the measured time.
+     *
+     * @return the elapsed time in nanoseconds.
+     */
+    uint64_t elapsed() const;
+
+    /**
+     * Number of operations to run.
+     */
+    const size_t iterations;
+
+    /**
+     * Benchmark argument (number of timers, observers...).
+     */
+    const long argument;
+
+    /**
+     * Number of operations really processed. Default to iterations when
+     * left to 0, the time per operation is computed from this value.
+     */
+    size_t items;
+
+  private:
+
+    uint64_t total;
+    struct timespec started;
+    bool running;
+  };
+
+  typedef void (*Function)(State& state);
+
+  /**
+   * Static registration of a benchmark.
+   */
+  class Registration
+  {
+  public:
+
+    Registration(const char *name, Function function, long argument = 0);
+  };
+
+  /**
+   * Prevent the compiler from optimizing a value away.
+   */
+  template<typename T>
+  inline void keep(const T& value)
+  {
+    asm volatile("" : : "g"(&value) : "memory");
+  }
+
+}
+
+#define OVK_BENCHMARK_CONCAT2(a, b) a##b
+#define OVK_BENCHMARK_CONCAT(a, b) OVK_BENCHMARK_CONCAT2(a, b)
+
+/**
+ * Register a benchmark function under a given name, with an optional argument.
+ */
+#define OVK_BENCHMARK(name, ...) \
+  static Benchmark::Registration OVK_BENCHMARK_CONCAT(benchmark, __LINE__)(name, __VA_ARGS__)
+
+#endif /* OVERKIZ_BENCHMARK_H_ */
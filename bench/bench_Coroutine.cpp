@@ -0,0 +1,70 @@
+/*
+ * bench_Coroutine.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <kizbox/framework/core/Coroutine.h>
+
+#include "Benchmark.h"
+
+class YieldCoroutine : public Overkiz::Coroutine
+{
+public:
+  YieldCoroutine() :
+    Overkiz::Coroutine(4 * 4096), running(true)
+  {
+  }
+
+  void entry()
+  {
+    while(running)
+    {
+      Overkiz::Coroutine::yield();
+    }
+  }
+
+  bool running;
+};
+
+class EmptyCoroutine : public Overkiz::Coroutine
+{
+public:
+  EmptyCoroutine() :
+    Overkiz::Coroutine(4 * 4096)
+  {
+  }
+
+  void entry()
+  {
+  }
+};
+
+static void resumeYield(Benchmark::State& state)
+{
+  state.pause();
+  Overkiz::Shared::Pointer<YieldCoroutine> coroutine = Overkiz::Shared::Pointer<YieldCoroutine>::create();
+  Overkiz::Coroutine::resume(coroutine);
+  state.resume();
+
+  for(size_t i = 0; i < state.iterations; i++)
+  {
+    Overkiz::Coroutine::resume(coroutine);
+  }
+
+  state.pause();
+  coroutine->running = false;
+  Overkiz::Coroutine::resume(coroutine);
+}
+
+static void launch(Benchmark::State& state)
+{
+  for(size_t i = 0; i < state.iterations; i++)
+  {
+    Overkiz::Shared::Pointer<EmptyCoroutine> coroutine = Overkiz::Shared::Pointer<EmptyCoroutine>::create();
+    Overkiz::Coroutine::resume(coroutine);
+  }
+}
+
+OVK_BENCHMARK("coroutine/resume_yield", resumeYield);
+OVK_BENCHMARK("coroutine/launch", launch);
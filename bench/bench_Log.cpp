@@ -0,0 +1,20 @@
+/*
+ * bench_Log.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <kizbox/framework/core/Log.h>
+
+#include "Benchmark.h"
+
+//Below the console level: only the syslog path is measured
+static void debug(Benchmark::State& state)
+{
+  for(size_t i = 0; i < state.iterations; i++)
+  {
+    OVK_DEBUG("Benchmark message %zu.", i);
+  }
+}
+
+OVK_BENCHMARK("log/debug", debug);
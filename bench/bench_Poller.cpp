@@ -0,0 +1,104 @@
+/*
+ * bench_Poller.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <kizbox/framework/core/Poller.h>
+#include <kizbox/framework/core/Watcher.h>
+#include <kizbox/framework/core/Event.h>
+
+#include "Benchmark.h"
+
+class ReadyWatcher : public Overkiz::Watcher
+{
+public:
+  ReadyWatcher(size_t iterations) :
+    Overkiz::Watcher(eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC), EPOLLIN), count(0), iterations(iterations)
+  {
+  }
+
+  virtual ~ReadyWatcher()
+  {
+    stop();
+    close(fd);
+  }
+
+  //The eventfd is never read: it stays readable and is dispatched at each poll
+  void process(uint32_t events)
+  {
+    if(++count >= iterations)
+    {
+      Overkiz::Poller::get()->stop();
+    }
+  }
+
+  size_t count;
+  size_t iterations;
+};
+
+class CountedEvent : public Overkiz::Event
+{
+public:
+  CountedEvent(size_t iterations) :
+    count(0), iterations(iterations)
+  {
+  }
+
+  void receive(uint64_t numberOfEvents)
+  {
+    if(++count < iterations)
+    {
+      send();
+    }
+    else
+    {
+      Overkiz::Poller::get()->stop();
+    }
+  }
+
+  size_t count;
+  size_t iterations;
+};
+
+static void dispatch(Benchmark::State& state)
+{
+  state.pause();
+  ReadyWatcher watcher(state.iterations);
+  watcher.start();
+  state.resume();
+  Overkiz::Poller::get()->loop();
+  state.pause();
+}
+
+static void eventSend(Benchmark::State& state)
+{
+  state.pause();
+  CountedEvent event(1);
+  state.resume();
+
+  for(size_t i = 0; i < state.iterations; i++)
+  {
+    event.send();
+  }
+
+  state.pause();
+  Overkiz::Poller::get()->loop();
+}
+
+static void eventRoundTrip(Benchmark::State& state)
+{
+  state.pause();
+  CountedEvent event(state.iterations);
+  event.send();
+  state.resume();
+  Overkiz::Poller::get()->loop();
+  state.pause();
+}
+
+OVK_BENCHMARK("poller/dispatch", dispatch);
+OVK_BENCHMARK("event/send", eventSend);
+OVK_BENCHMARK("event/round_trip", eventRoundTrip);
@@ -0,0 +1,83 @@
+/*
+ * bench_Shared.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <kizbox/framework/core/Shared.h>
+#include <kizbox/framework/core/Subject.h>
+
+#include "Benchmark.h"
+
+class Observer
+{
+public:
+  Observer() :
+    count(0)
+  {
+  }
+
+  virtual ~Observer()
+  {
+  }
+
+  virtual void notified(Overkiz::Subject<Observer> *subject, int value)
+  {
+    count += value;
+  }
+
+  long count;
+};
+
+class Value
+{
+public:
+  Value() :
+    value(0)
+  {
+  }
+
+  int value;
+};
+
+class Notifier : public Overkiz::Subject<Observer>
+{
+public:
+  void fire(int value)
+  {
+    notify(value);
+  }
+};
+
+static void pointerCopy(Benchmark::State& state)
+{
+  Overkiz::Shared::Pointer<Value> pointer = Overkiz::Shared::Pointer<Value>::create();
+
+  for(size_t i = 0; i < state.iterations; i++)
+  {
+    Overkiz::Shared::Pointer<Value> copy(pointer);
+    Benchmark::keep(copy);
+  }
+}
+
+static void subjectNotify(Benchmark::State& state)
+{
+  state.pause();
+  Notifier subject;
+
+  for(long i = 0; i < state.argument; i++)
+  {
+    subject.add(Overkiz::Shared::Pointer<Observer>::create());
+  }
+
+  state.resume();
+
+  for(size_t i = 0; i < state.iterations; i++)
+  {
+    subject.fire(1);
+  }
+}
+
+OVK_BENCHMARK("shared/pointer_copy", pointerCopy);
+OVK_BENCHMARK("subject/notify", subjectNotify, 1);
+OVK_BENCHMARK("subject/notify", subjectNotify, 16);
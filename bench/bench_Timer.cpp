@@ -0,0 +1,95 @@
+/*
+ * bench_Timer.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <vector>
+
+#include <kizbox/framework/core/Poller.h>
+#include <kizbox/framework/core/Timer.h>
+
+#include "Benchmark.h"
+
+class CountedTimer : public Overkiz::Timer::Monotonic
+{
+public:
+  CountedTimer() :
+    Overkiz::Timer::Monotonic(false)
+  {
+  }
+
+  void expired(const Overkiz::Time::Monotonic& time)
+  {
+    if(--remaining == 0)
+    {
+      Overkiz::Poller::get()->stop();
+    }
+  }
+
+  static size_t remaining;
+};
+
+size_t CountedTimer::remaining = 0;
+
+/*
+ * Timers are armed from the latest deadline to the earliest one: each start
+ * is inserted at the head of the sorted list and the setup stays linear.
+ */
+static void arm(std::vector<CountedTimer>& timers, const Overkiz::Time::Monotonic& deadline)
+{
+  Overkiz::Time::Elapsed step = { 0, 1 };
+  Overkiz::Time::Monotonic time = deadline;
+
+  for(auto it = timers.rbegin(); it != timers.rend(); ++it)
+  {
+    it->setTime(time);
+    it->start();
+    time -= step;
+  }
+}
+
+static void startStop(Benchmark::State& state)
+{
+  state.pause();
+  Overkiz::Time::Elapsed hour = { 3600, 0 };
+  std::vector<CountedTimer> timers(state.argument);
+  arm(timers, Overkiz::Time::Monotonic::now() + hour);
+  //Deadline in the middle of the pending timers
+  CountedTimer timer;
+  timer.setTime(timers[state.argument / 2].getTime());
+  state.resume();
+
+  for(size_t i = 0; i < state.iterations; i++)
+  {
+    timer.start();
+    timer.stop();
+  }
+
+  state.pause();
+}
+
+static void expire(Benchmark::State& state)
+{
+  state.pause();
+  std::vector<CountedTimer> timers(state.argument);
+
+  for(size_t i = 0; i < state.iterations; i++)
+  {
+    //Every deadline is already reached
+    arm(timers, Overkiz::Time::Monotonic::now());
+    CountedTimer::remaining = timers.size();
+    state.resume();
+    Overkiz::Poller::get()->loop();
+    state.pause();
+  }
+
+  state.items = state.iterations * timers.size();
+}
+
+OVK_BENCHMARK("timer/start_stop", startStop, 1000);
+OVK_BENCHMARK("timer/start_stop", startStop, 10000);
+OVK_BENCHMARK("timer/start_stop", startStop, 100000);
+OVK_BENCHMARK("timer/expire", expire, 1000);
+OVK_BENCHMARK("timer/expire", expire, 10000);
+OVK_BENCHMARK("timer/expire", expire, 100000);
@@ -0,0 +1,364 @@
+/*
+ * bench_main.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <kizbox/framework/core/Poller.h>
+
+#include "config.h"
+#include "Benchmark.h"
+
+namespace Benchmark
+{
+
+  struct Entry
+  {
+    std::string name;
+    Function function;
+    long argument;
+  };
+
+  struct Result
+  {
+    std::string name;
+    size_t iterations;
+    double median;
+    double min;
+    double max;
+  };
+
+  static std::vector<Entry>& registry()
+  {
+    static std::vector<Entry> entries;
+    return entries;
+  }
+
+  static uint64_t diff(const struct timespec& from, const struct timespec& to)
+  {
+    return (uint64_t)(to.tv_sec - from.tv_sec) * 1000000000ULL + to.tv_nsec - from.tv_nsec;
+  }
+
+  State::State(size_t count, long arg) :
+    iterations(count), argument(arg), items(0), total(0), running(false)
+  {
+  }
+
+  void State::pause()
+  {
+    if(running)
+    {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      total += diff(started, now);
+      running = false;
+    }
+  }
+
+  void State::resume()
+  {
+    if(!running)
+    {
+      running = true;
+      clock_gettime(CLOCK_MONOTONIC, &started);
+    }
+  }
+
+  uint64_t State::elapsed() const
+  {
+    return total;
+  }
+
+  Registration::Registration(const char *name, Function function, long argument)
+  {
+    Entry entry;
+    entry.name = name;
+
+    if(argument)
+    {
+      entry.name += "/" + std::to_string(argument);
+    }
+
+    entry.function = function;
+    entry.argument = argument;
+    registry().push_back(entry);
+  }
+
+  static double measure(const Entry& entry, size_t iterations, uint64_t *elapsed)
+  {
+    State state(iterations, entry.argument);
+    state.resume();
+    entry.function(state);
+    state.pause();
+    size_t items = state.items ? state.items : iterations;
+    *elapsed = state.elapsed();
+    return (double) state.elapsed() / items;
+  }
+
+  static Result run(const Entry& entry, uint64_t minTime, unsigned repeat)
+  {
+    Result result;
+    size_t iterations = 1;
+    uint64_t elapsed;
+
+    //Calibrate the number of iterations to last at least minTime
+    for(;;)
+    {
+      measure(entry, iterations, &elapsed);
+
+      if(elapsed >= minTime || iterations >= 1000000000)
+      {
+        break;
+      }
+
+      double factor = elapsed ? 1.4 * minTime / elapsed : 100;
+      factor = std::min(std::max(factor, 2.0), 100.0);
+      iterations = (size_t)(iterations * factor);
+    }
+
+    std::vector<double> samples;
+
+    for(unsigned i = 0; i < repeat; i++)
+    {
+      samples.push_back(measure(entry, iterations, &elapsed));
+    }
+
+    std::sort(samples.begin(), samples.end());
+    result.name = entry.name;
+    result.iterations = iterations;
+    result.median = samples[samples.size() / 2];
+    result.min = samples.front();
+    result.max = samples.back();
+    return result;
+  }
+
+  static std::map<std::string, double> load(const char *path)
+  {
+    std::map<std::string, double> baseline;
+    FILE *file = fopen(path, "r");
+
+    if(!file)
+    {
+      fprintf(stderr, "Couldn't open baseline %s.\n", path);
+      exit(2);
+    }
+
+    std::string content;
+    char buffer[4096];
+    size_t size;
+
+    while((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+      content.append(buffer, size);
+    }
+
+    fclose(file);
+
+    static const char nameKey[] = "\"name\": \"";
+    static const char valueKey[] = "\"ns_per_op\": ";
+    size_t pos = 0;
+
+    while((pos = content.find(nameKey, pos)) != std::string::npos)
+    {
+      pos += sizeof(nameKey) - 1;
+      size_t end = content.find('"', pos);
+      size_t next = content.find(nameKey, end);
+      size_t value = content.find(valueKey, end);
+
+      if(end == std::string::npos || value == std::string::npos || value > next)
+      {
+        continue;
+      }
+
+      baseline[content.substr(pos, end - pos)] = strtod(content.c_str() + value + sizeof(valueKey) - 1, nullptr);
+    }
+
+    return baseline;
+  }
+
+  static void usage(const char *program)
+  {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -l, --list                list benchmarks\n"
+            "  -f, --filter <text>       run benchmarks whose name contains text\n"
+            "  -t, --min-time <ms>       minimum duration of one sample (default 100)\n"
+            "  -r, --repeat <count>      number of samples (default 5)\n"
+            "  -s, --simple              use a poller with simple tasks\n"
+            "  -o, --output <file>       write JSON results to file (default stdout)\n"
+            "  -b, --baseline <file>     compare with a previous JSON result\n"
+            "  -T, --threshold <percent> regression threshold (default 10)\n",
+            program);
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  static const struct option options[] =
+  {
+    { "list", no_argument, nullptr, 'l' },
+    { "filter", required_argument, nullptr, 'f' },
+    { "min-time", required_argument, nullptr, 't' },
+    { "repeat", required_argument, nullptr, 'r' },
+    { "simple", no_argument, nullptr, 's' },
+    { "output", required_argument, nullptr, 'o' },
+    { "baseline", required_argument, nullptr, 'b' },
+    { "threshold", required_argument, nullptr, 'T' },
+    { "help", no_argument, nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 }
+  };
+
+  const char *filter = "";
+  const char *output = nullptr;
+  const char *baselinePath = nullptr;
+  uint64_t minTime = 100000000;
+  unsigned repeat = 5;
+  double threshold = 10;
+  bool interruptible = true;
+  bool list = false;
+  int opt;
+
+  while((opt = getopt_long(argc, argv, "lf:t:r:so:b:T:h", options, nullptr)) != -1)
+  {
+    switch(opt)
+    {
+      case 'l':
+        list = true;
+        break;
+
+      case 'f':
+        filter = optarg;
+        break;
+
+      case 't':
+        minTime = strtoull(optarg, nullptr, 10) * 1000000;
+        break;
+
+      case 'r':
+        repeat = std::max(1, atoi(optarg));
+        break;
+
+      case 's':
+        interruptible = false;
+        break;
+
+      case 'o':
+        output = optarg;
+        break;
+
+      case 'b':
+        baselinePath = optarg;
+        break;
+
+      case 'T':
+        threshold = strtod(optarg, nullptr);
+        break;
+
+      default:
+        Benchmark::usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+
+  if(list)
+  {
+    for(auto& entry : Benchmark::registry())
+    {
+      printf("%s\n", entry.name.c_str());
+    }
+
+    return 0;
+  }
+
+  std::map<std::string, double> baseline;
+
+  if(baselinePath)
+  {
+    baseline = Benchmark::load(baselinePath);
+  }
+
+  //Every benchmark of this process shares the poller of the main thread
+  Overkiz::Poller::get(interruptible, false);
+
+  std::vector<Benchmark::Result> results;
+
+  for(auto& entry : Benchmark::registry())
+  {
+    if(entry.name.find(filter) == std::string::npos)
+    {
+      continue;
+    }
+
+    fprintf(stderr, "%-40s", entry.name.c_str());
+    results.push_back(Benchmark::run(entry, minTime, repeat));
+    fprintf(stderr, " %12.1f ns/op\n", results.back().median);
+  }
+
+  FILE *out = output ? fopen(output, "w") : stdout;
+
+  if(!out)
+  {
+    fprintf(stderr, "Couldn't open %s.\n", output);
+    return 2;
+  }
+
+  #ifdef ASM_COROUTINE
+  const char *context = "asm";
+  #else
+  const char *context = "ucontext";
+  #endif
+  int regressions = 0;
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"library\": \"%s\",\n", PACKAGE_NAME);
+  fprintf(out, "  \"version\": \"%s\",\n", PACKAGE_VERSION);
+  fprintf(out, "  \"context\": \"%s\",\n", context);
+  fprintf(out, "  \"tasks\": \"%s\",\n", interruptible ? "interruptible" : "simple");
+  fprintf(out, "  \"benchmarks\": [");
+
+  for(size_t i = 0; i < results.size(); i++)
+  {
+    const Benchmark::Result& result = results[i];
+    fprintf(out, "%s\n    {\n", i ? "," : "");
+    fprintf(out, "      \"name\": \"%s\",\n", result.name.c_str());
+    fprintf(out, "      \"iterations\": %zu,\n", result.iterations);
+    fprintf(out, "      \"ns_per_op\": %.2f,\n", result.median);
+    fprintf(out, "      \"min_ns_per_op\": %.2f,\n", result.min);
+    fprintf(out, "      \"max_ns_per_op\": %.2f", result.max);
+
+    auto it = baseline.find(result.name);
+
+    if(it != baseline.end() && it->second > 0)
+    {
+      double change = 100 * (result.median - it->second) / it->second;
+      bool regression = change > threshold;
+      regressions += regression;
+      fprintf(out, ",\n      \"baseline_ns_per_op\": %.2f,\n", it->second);
+      fprintf(out, "      \"change_percent\": %.2f,\n", change);
+      fprintf(out, "      \"regression\": %s", regression ? "true" : "false");
+      fprintf(stderr, "%-40s %12.1f -> %12.1f ns/op %+7.1f%%%s\n", result.name.c_str(),
+              it->second, result.median, change, regression ? " REGRESSION" : "");
+    }
+
+    fprintf(out, "\n    }");
+  }
+
+  fprintf(out, "\n  ]\n}\n");
+
+  if(output)
+  {
+    fclose(out);
+  }
+
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+/*
+ * Channel.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_CHANNEL_H_
+#define OVERKIZ_CHANNEL_H_
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+
+#include <kizbox/framework/core/Coroutine.h>
+#include <kizbox/framework/core/Timer.h>
+#include <kizbox/framework/core/Time.h>
+
+namespace Overkiz
+{
+
+  /**
+   * Timer notifying a waiter when a deadline is reached.
+   * The timer is started on construction and stopped on destruction.
+   */
+  class Coroutine::Timeout: public Timer::Monotonic
+  {
+  public:
+
+    /**
+     * Constructor.
+     *
+     * @param waiter : the waiter to notify.
+     * @param deadline : the absolute monotonic deadline.
+     * @return a new running timeout.
+     */
+    Timeout(Waiter& waiter, const Time::Monotonic& deadline);
+
+    /**
+     * Destructor.
+     *
+     * @return
+     */
+    virtual ~Timeout();
+
+    /**
+     * Test if the deadline has been reached.
+     *
+     * @return true if the waiter has been notified by this timeout.
+     */
+    bool isExpired() const;
+
+    /**
+     * Compute an absolute deadline.
+     *
+     * @param timeout : the relative timeout.
+     * @return the deadline.
+     */
+    static Time::Monotonic deadline(const Time::Monotonic& timeout);
+
+  private:
+
+    void expired(const Time::Monotonic& time);
+
+    Waiter& waiter;
+    bool fired;
+  };
+
+  /**
+   * Bounded channel between the coroutines of one thread.
+   * Values are stored in a fixed ring of N elements: sending or receiving
+   * never allocates memory.
+   * send pauses the running coroutine while the channel is full and
+   * receive pauses it while the channel is empty. The paused coroutine is
+   * scheduled again by the task manager as soon as the channel is ready.
+   */
+  template<typename T, size_t N>
+  class Coroutine::Channel
+  {
+  public:
+
+    static_assert(N > 0, "Channel capacity must not be null");
+
+    /**
+     * Constructor.
+     *
+     * @return an empty opened channel.
+     */
+    Channel() :
+      first(0), count(0), closed(false)
+    {
+    }
+
+    /**
+     * Destructor.
+     * Remaining values are destroyed.
+     *
+     * @return
+     */
+    virtual ~Channel()
+    {
+      while(count)
+      {
+        pop();
+      }
+    }
+
+    /**
+     * Send a value without waiting.
+     *
+     * @param value : the value to send.
+     * @return false if the channel is full or closed.
+     */
+    bool trySend(const T& value)
+    {
+      if(closed || count == N)
+      {
+        return false;
+      }
+
+      new(slot((first + count) % N)) T(value);
+      count++;
+      readers.notify();
+      return true;
+    }
+
+    /**
+     * Receive a value without waiting.
+     *
+     * @param value : the received value.
+     * @return false if the channel is empty.
+     */
+    bool tryReceive(T& value)
+    {
+      if(!count)
+      {
+        return false;
+      }
+
+      value = *slot(first);
+      pop();
+      writers.notify();
+      return true;
+    }
+
+    /**
+     * Send a value, pause the running coroutine while the channel is full.
+     *
+     * @param value : the value to send.
+     * @return false if the channel is closed.
+     */
+    bool send(const T& value)
+    {
+      while(!trySend(value))
+      {
+        if(closed)
+        {
+          return false;
+        }
+
+        writers.wait();
+      }
+
+      return true;
+    }
+
+    /**
+     * Send a value, pause the running coroutine while the channel is full
+     * and the timeout is not reached.
+     *
+     * @param value : the value to send.
+     * @param timeout : the maximum relative time to wait.
+     * @return false if the channel is closed or the timeout is reached.
+     */
+    bool send(const T& value, const Time::Monotonic& timeout)
+    {
+      Time::Monotonic deadline = Timeout::deadline(timeout);
+
+      while(!trySend(value))
+      {
+        if(closed || !wait(writers, deadline))
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    /**
+     * Receive a value, pause the running coroutine while the channel is empty.
+     *
+     * @param value : the received value.
+     * @return false if the channel is closed and empty.
+     */
+    bool receive(T& value)
+    {
+      while(!tryReceive(value))
+      {
+        if(closed)
+        {
+          return false;
+        }
+
+        readers.wait();
+      }
+
+      return true;
+    }
+
+    /**
+     * Receive a value, pause the running coroutine while the channel is empty
+     * and the timeout is not reached.
+     *
+     * @param value : the received value.
+     * @param timeout : the maximum relative time to wait.
+     * @return false if the channel is closed and empty or the timeout is reached.
+     */
+    bool receive(T& value, const Time::Monotonic& timeout)
+    {
+      Time::Monotonic deadline = Timeout::deadline(timeout);
+
+      while(!tryReceive(value))
+      {
+        if(closed || !wait(readers, deadline))
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    /**
+     * Close the channel.
+     * Waiting senders and receivers are woken up, remaining values can
+     * still be received.
+     */
+    void close()
+    {
+      closed = true;
+      readers.notifyAll();
+      writers.notifyAll();
+    }
+
+    bool isClosed() const
+    {
+      return closed;
+    }
+
+    bool empty() const
+    {
+      return count == 0;
+    }
+
+    bool full() const
+    {
+      return count == N;
+    }
+
+    size_t size() const
+    {
+      return count;
+    }
+
+    size_t capacity() const
+    {
+      return N;
+    }
+
+  private:
+
+    Channel(const Channel& channel);
+
+    Channel& operator = (const Channel& channel);
+
+    T *slot(size_t index)
+    {
+      return reinterpret_cast<T *>(&ring[index]);
+    }
+
+    void pop()
+    {
+      slot(first)->~T();
+      first = (first + 1) % N;
+      count--;
+    }
+
+    static bool wait(WaitQueue& queue, const Time::Monotonic& deadline)
+    {
+      Waiter waiter;
+      WaitQueue::Node node(waiter, queue);
+      Timeout timeout(waiter, deadline);
+      waiter.suspend();
+      return !timeout.isExpired();
+    }
+
+    typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type ring[N];
+    size_t first;
+    size_t count;
+    bool closed;
+
+    WaitQueue readers;
+    WaitQueue writers;
+
+    template<size_t M> friend class Coroutine::Select;
+  };
+
+  /**
+   * Wait for the first ready channel among several channels.
+   * A receive case is ready when its channel is not empty or closed,
+   * a send case is ready when its channel is not full or closed.
+   * Up to N cases can be registered.
+   */
+  template<size_t N>
+  class Coroutine::Select
+  {
+  public:
+
+    class Exception: public Overkiz::Exception
+    {
+    public:
+
+      Exception()
+      {
+      }
+
+      virtual ~Exception()
+      {
+      }
+
+      const char *getId() const
+      {
+        return "com.overkiz.Framework.Core.Coroutine.Select.Exception";
+      }
+    };
+
+    /**
+     * Constructor.
+     *
+     * @return a select without any case.
+     */
+    Select() :
+      size(0)
+    {
+    }
+
+    virtual ~Select()
+    {
+    }
+
+    /**
+     * Add a receive case.
+     *
+     * @param channel : the channel to receive from.
+     * @return the case index.
+     */
+    template<typename T, size_t M>
+    int receive(Channel<T, M>& channel)
+    {
+      return add(&channel, &channel.readers, &Select::readable<T, M>);
+    }
+
+    /**
+     * Add a send case.
+     *
+     * @param channel : the channel to send to.
+     * @return the case index.
+     */
+    template<typename T, size_t M>
+    int send(Channel<T, M>& channel)
+    {
+      return add(&channel, &channel.writers, &Select::writable<T, M>);
+    }
+
+    /**
+     * Pause the running coroutine until a case is ready.
+     * Once woken, the case of the channel which woke it is preferred.
+     *
+     * @return the index of the ready case.
+     */
+    int wait()
+    {
+      int index;
+
+      while((index = ready()) < 0)
+      {
+        Waiter waiter;
+        WaitQueue::Node nodes[N];
+
+        for(size_t i = 0; i < size; i++)
+        {
+          nodes[i].link(waiter, *cases[i].queue);
+        }
+
+        waiter.suspend();
+
+        if((index = ready(waiter.getSource())) >= 0)
+        {
+          return index;
+        }
+      }
+
+      return index;
+    }
+
+    /**
+     * Pause the running coroutine until a case is ready or the timeout is reached.
+     *
+     * @param timeout : the maximum relative time to wait.
+     * @return the index of the ready case, -1 if the timeout is reached.
+     */
+    int wait(const Time::Monotonic& timeout)
+    {
+      Time::Monotonic deadline = Timeout::deadline(timeout);
+      int index;
+
+      while((index = ready()) < 0)
+      {
+        Waiter waiter;
+        WaitQueue::Node nodes[N];
+
+        for(size_t i = 0; i < size; i++)
+        {
+          nodes[i].link(waiter, *cases[i].queue);
+        }
+
+        Timeout timer(waiter, deadline);
+        waiter.suspend();
+
+        if(timer.isExpired())
+        {
+          return ready();
+        }
+
+        if((index = ready(waiter.getSource())) >= 0)
+        {
+          return index;
+        }
+      }
+
+      return index;
+    }
+
+  private:
+
+    struct Case
+    {
+      void *channel;
+      WaitQueue *queue;
+      bool (*ready)(void *channel);
+    };
+
+    int add(void *channel, WaitQueue *queue, bool (*isReady)(void *))
+    {
+      if(size == N)
+      {
+        throw Exception();
+      }
+
+      cases[size].channel = channel;
+      cases[size].queue = queue;
+      cases[size].ready = isReady;
+      return size++;
+    }
+
+    int ready() const
+    {
+      for(size_t i = 0; i < size; i++)
+      {
+        if(cases[i].ready(cases[i].channel))
+        {
+          return i;
+        }
+      }
+
+      return -1;
+    }
+
+    int ready(const WaitQueue *source) const
+    {
+      //The case of the notifying queue comes first, its notification would be lost otherwise
+      for(size_t i = 0; i < size; i++)
+      {
+        if(cases[i].queue == source && cases[i].ready(cases[i].channel))
+        {
+          return i;
+        }
+      }
+
+      return ready();
+    }
+
+    template<typename T, size_t M>
+    static bool readable(void *channel)
+    {
+      Channel<T, M> *chan = static_cast<Channel<T, M> *>(channel);
+      return !chan->empty() || chan->isClosed();
+    }
+
+    template<typename T, size_t M>
+    static bool writable(void *channel)
+    {
+      Channel<T, M> *chan = static_cast<Channel<T, M> *>(channel);
+      return !chan->full() || chan->isClosed();
+    }
+
+    Case cases[N];
+    size_t size;
+  };
+
+}
+
+#endif /* OVERKIZ_CHANNEL_H_ */
@@ -0,0 +1,102 @@
+/*
+ * Clock.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_CLOCK_H_
+#define OVERKIZ_CLOCK_H_
+
+#include <time.h>
+
+namespace Overkiz
+{
+
+  namespace Time
+  {
+
+    /**
+     * Clock sources of Time::Monotonic and Time::Real.
+     *
+     * The poller of a thread starts an iteration each time epoll_wait()
+     * returns: the first cached read of the iteration reads the clock, the
+     * next ones return the same time. Outside of a loop, cached reads read
+     * the clock.
+     *
+     * The cycle counter of the CPU (TSC on x86, CNTVCT on ARM) is read
+     * without the vDSO. It is only used when the kernel uses it as its
+     * clock source, which guarantees that it is stable and synchronized
+     * between the cores. It is calibrated once against CLOCK_MONOTONIC and
+     * isn't adjusted by NTP afterwards: it measures durations between fast
+     * reads.
+     */
+    class Clock
+    {
+    public:
+
+      /**
+       * Start an iteration of the poller of the calling thread.
+       */
+      static void tick();
+
+      /**
+       * Stop caching the time for the calling thread.
+       */
+      static void release();
+
+      /**
+       * Get CLOCK_MONOTONIC, cached during an iteration.
+       *
+       * @param time : the current time.
+       */
+      static void monotonic(struct timespec & time);
+
+      /**
+       * Get CLOCK_REALTIME, cached during an iteration.
+       *
+       * @param time : the current time.
+       */
+      static void real(struct timespec & time);
+
+      /**
+       * Get the cycle counter converted to a monotonic time, or
+       * CLOCK_MONOTONIC if the counter isn't enabled.
+       *
+       * @param time : the current time.
+       */
+      static void fast(struct timespec & time);
+
+      /**
+       * Enable or disable the cycle counter for the fast reads of all the
+       * threads. The counter is calibrated by the first call, for 10ms on
+       * x86.
+       *
+       * @param enabled : true to use the counter.
+       * @return false if the counter can't be used.
+       */
+      static bool setCounter(bool enabled);
+
+      /**
+       * Check if the fast reads use the cycle counter.
+       *
+       * @return true if the counter is enabled.
+       */
+      static bool hasCounter();
+
+    private:
+
+      Clock();
+
+      /**
+       * Calibrate the counter.
+       *
+       * @return false if the counter can't be used.
+       */
+      static bool calibrate();
+    };
+
+  }
+
+}
+
+#endif /* OVERKIZ_CLOCK_H_ */
@@ -8,6 +8,8 @@
 #define OVERKIZ_COROUTINE_H_
 
 #include <stddef.h>
+#include <atomic>
+#include <vector>
 
 #include <kizbox/framework/core/Thread.h>
 #include <kizbox/framework/core/Context.h>
@@ -56,6 +58,278 @@ namespace Overkiz
       WAITING, //!< WAITING
     } Status;
 
+    /**
+     * Options of the coroutine stack.
+     */
+    typedef enum
+    {
+      PREFAULTED = 0x1, //!< Pages are allocated by the constructor (MAP_POPULATE)
+      LOCKED = 0x2, //!< Pages are locked in memory (mlock)
+    } Option;
+
+    /**
+     * Storage local to a coroutine.
+     * Each instance reserves a slot inside every coroutine control block.
+     * The value is created on first access from the running coroutine and
+     * destroyed when this coroutine ends.
+     * Outside of any coroutine, the value belongs to the thread main context.
+     * Slots are never recycled, so instances should be long lived (static).
+     */
+    template<typename T>
+    class Local
+    {
+    public:
+
+      /**
+       * Constructor.
+       *
+       * @return a new coroutine local storage.
+       */
+      Local() :
+        slot(reserve())
+      {
+      }
+
+      /**
+       * Destructor.
+       * Values already created are destroyed with their coroutine.
+       *
+       * @return
+       */
+      virtual ~Local()
+      {
+      }
+
+      /**
+       * Get the value of the running coroutine.
+       * The value is default constructed on first access.
+       *
+       * @return the value of the running coroutine.
+       */
+      T *get()
+      {
+        Coroutine & coro = *self();
+
+        if(!coro.localStorage(slot).value)
+        {
+          T *value = new T();
+          //Slots may have been reallocated by the value constructor
+          Storage & storage = coro.localStorage(slot);
+          storage.value = value;
+          storage.destroy = &Local::destroy;
+        }
+
+        return static_cast<T *>(coro.localStorage(slot).value);
+      }
+
+      T& operator *()
+      {
+        return *get();
+      }
+
+      T *operator ->()
+      {
+        return get();
+      }
+
+      /**
+       * Test if the running coroutine has a value.
+       *
+       * @return true if the value has not been created yet.
+       */
+      bool empty()
+      {
+        return self()->localStorage(slot).value == nullptr;
+      }
+
+      /**
+       * Destroy the value of the running coroutine.
+       */
+      void reset()
+      {
+        Storage & storage = self()->localStorage(slot);
+        void *value = storage.value;
+        storage.value = nullptr;
+
+        if(value)
+        {
+          destroy(value);
+        }
+      }
+
+    private:
+
+      static void destroy(void *value)
+      {
+        delete static_cast<T *>(value);
+      }
+
+      size_t slot;
+    };
+
+    class WaitQueue;
+
+    /**
+     * State of the running coroutine while it waits to be notified
+     * by one or more wait queues.
+     * A waiter must be created by the coroutine which waits.
+     */
+    class Waiter
+    {
+    public:
+
+      /**
+       * Constructor.
+       * Throw a Coroutine::Exception if the running context is not a coroutine.
+       *
+       * @return a new waiter for the running coroutine.
+       */
+      Waiter();
+
+      /**
+       * Destructor.
+       *
+       * @return
+       */
+      virtual ~Waiter();
+
+      /**
+       * Pause the running coroutine until this waiter is notified.
+       */
+      void suspend();
+
+      /**
+       * Notify this waiter and wake its coroutine.
+       *
+       * @param queue : the notifying queue, nullptr if not notified by a queue (timeout).
+       * @return false if the waiter was already notified.
+       */
+      bool notify(const WaitQueue *queue);
+
+      /**
+       * Test if this waiter has been notified.
+       *
+       * @return true if notified.
+       */
+      bool isNotified() const;
+
+      /**
+       * Get the queue which notified this waiter.
+       *
+       * @return the notifying queue, nullptr if not notified by a queue.
+       */
+      const WaitQueue *getSource() const;
+
+    private:
+
+      Shared::Pointer<Coroutine> coroutine;
+      const WaitQueue *source;
+      bool notified;
+      bool suspended;
+    };
+
+    /**
+     * Intrusive FIFO of waiters.
+     * It is the building block of synchronization primitives between
+     * the coroutines of one thread. No memory is allocated to wait.
+     */
+    class WaitQueue
+    {
+    public:
+
+      /**
+       * Registration of a waiter into a queue.
+       * A node unlinks itself when destroyed.
+       */
+      class Node
+      {
+      public:
+
+        Node();
+
+        Node(Waiter& waiter, WaitQueue& queue);
+
+        virtual ~Node();
+
+        /**
+         * Register a waiter into a queue.
+         *
+         * @param waiter : the waiter to register.
+         * @param queue : the queue to wait for.
+         */
+        void link(Waiter& waiter, WaitQueue& queue);
+
+        /**
+         * Unregister the waiter from its queue.
+         */
+        void unlink();
+
+      private:
+
+        Node(const Node& node);
+
+        Node& operator = (const Node& node);
+
+        Waiter *waiter;
+        WaitQueue *queue;
+        Node *prev;
+        Node *next;
+
+        friend class WaitQueue;
+      };
+
+      WaitQueue();
+
+      virtual ~WaitQueue();
+
+      /**
+       * Pause the running coroutine until it is notified by this queue.
+       */
+      void wait();
+
+      /**
+       * Wake the first waiter.
+       *
+       * @return true if a waiter has been notified.
+       */
+      bool notify();
+
+      /**
+       * Wake all waiters.
+       */
+      void notifyAll();
+
+      /**
+       * Test if there is any waiter.
+       *
+       * @return true if nobody waits.
+       */
+      bool empty() const;
+
+    private:
+
+      WaitQueue(const WaitQueue& queue);
+
+      WaitQueue& operator = (const WaitQueue& queue);
+
+      Node *head;
+      Node *tail;
+    };
+
+    class Timeout;
+
+    template<typename T, size_t N> class Channel;
+
+    template<size_t N = 8> class Select;
+
+    class Synchronizer;
+
+    class Mutex;
+
+    class Condition;
+
+    class Semaphore;
+
     /**
      * Resume a given coroutine.
      *
@@ -63,6 +337,15 @@ namespace Overkiz
      */
     static void resume(Shared::Pointer<Coroutine>& coro);
 
+    /**
+     * Wake a coroutine paused by a synchronization primitive.
+     * If the coroutine is owned by a task manager, it is scheduled by its
+     * manager, else it is resumed immediately.
+     *
+     * @param coro : the coroutine to wake.
+     */
+    static void wake(Shared::Pointer<Coroutine>& coro);
+
     /**
      * Resume a given coroutine.
      *
@@ -80,6 +363,16 @@ namespace Overkiz
      */
     static void yield();
 
+    /**
+     * Pause the running coroutine if its budget is spent.
+     * The coroutine is scheduled again after the other ready coroutines.
+     * Outside of a coroutine owned by a task manager with a budget,
+     * this method does nothing.
+     *
+     * @return true if the coroutine has been paused.
+     */
+    static bool maybeYield();
+
     /**
      * Entry point is called when the coroutine is launched.
      */
@@ -101,6 +394,34 @@ namespace Overkiz
     {
     }
 
+    /**
+     * Resume point is called in the coroutine context when a paused
+     * coroutine runs again. An exception thrown here is raised by yield.
+     */
+    virtual void resumed()
+    {
+    }
+
+    /**
+     * Reschedule point is called when the coroutine is woken up.
+     *
+     * @return false to let the waker resume the coroutine immediately.
+     */
+    virtual bool reschedule()
+    {
+      return false;
+    }
+
+    /**
+     * Preemption point is called by maybeYield.
+     *
+     * @return true if the coroutine has spent its budget.
+     */
+    virtual bool preempt()
+    {
+      return false;
+    }
+
     /**
      * Get the coroutine status.
      *
@@ -115,6 +436,13 @@ namespace Overkiz
      */
     size_t stackSize();
 
+    /**
+     * Get the options of the coroutine stack.
+     *
+     * @return the applied options, a combination of Option values.
+     */
+    unsigned stackOptions() const;
+
     /**
      * Get the running coroutine.
      *
@@ -131,10 +459,13 @@ namespace Overkiz
     /**
      * Constructor.
      *
+     * A stack which can't be locked is logged and kept unlocked.
+     *
      * @param stackSize : size of the coroutine stack.
+     * @param options : stack options, a combination of Option values.
      * @return a new coroutine.
      */
-    Coroutine(size_t stackSize);
+    Coroutine(size_t stackSize, unsigned options = 0);
 
     /**
      * Destructor.
@@ -155,6 +486,35 @@ namespace Overkiz
 
     void launch();
 
+    /**
+     * A coroutine local storage slot.
+     */
+    struct Storage
+    {
+      void *value;
+      void (*destroy)(void *value);
+    };
+
+    /**
+     * Get a local storage slot, the slots are grown on demand.
+     *
+     * @param slot : the slot index.
+     * @return the slot storage.
+     */
+    Storage& localStorage(size_t slot);
+
+    /**
+     * Destroy all local values of this coroutine.
+     */
+    void clear();
+
+    /**
+     * Reserve a new local storage slot.
+     *
+     * @return the slot index.
+     */
+    static size_t reserve();
+
     struct
     {
       void *base;
@@ -162,11 +522,14 @@ namespace Overkiz
     } stack;
 
     size_t size;
+    unsigned options;
     Status state;
+    std::vector<Storage> locals;
     #ifdef VALGRIND
     int valgrind;
     #endif
     static Thread::Key<Coroutine> current;
+    static std::atomic<size_t> slots;
 
     #ifndef ASM_COROUTINE
     ucontext_t ctx;
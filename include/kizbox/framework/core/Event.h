@@ -80,6 +80,8 @@ namespace Overkiz
 
       void process(uint32_t evts);
 
+      size_t clients() const;
+
       static Thread::Key<Manager> manager;
 
       std::vector<Event*> wevents;
@@ -0,0 +1,319 @@
+/*
+ * Generator.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_GENERATOR_H_
+#define OVERKIZ_GENERATOR_H_
+
+#include <exception>
+#include <functional>
+#include <iterator>
+
+#include <kizbox/framework/core/Coroutine.h>
+#include <kizbox/framework/core/Iterator.h>
+#include <kizbox/framework/core/Log.h>
+
+namespace Overkiz
+{
+
+  /**
+   * A generator produces a lazy sequence of values from a coroutine.
+   * The values are produced by the function given to the constructor with
+   * yield(), one at a time, when the consumer asks for the next value: no
+   * intermediate container is built.
+   *
+   * The generator can be iterated with a range-for loop or through the
+   * Iterator::Interface methods. An exception thrown by the body is rethrown
+   * to the consumer. The body must not wait for another coroutine, and must
+   * not catch the exception thrown by yield() when the generator is stopped.
+   *
+   * Example:
+   *   Generator<int> numbers([](Generator<int>& gen)
+   *   {
+   *     for(int i = 0; i < 3; i++)
+   *       gen.yield(i);
+   *   });
+   *
+   *   for(int n : numbers)
+   *     printf("%d\n", n);
+   */
+  template<typename T>
+  class Generator: public Iterator::Interface<T>
+  {
+  public:
+
+    typedef std::function<void(Generator& generator)> Function;
+
+    /**
+     * Input iterator over the generated values.
+     * All iterators of a generator share its position.
+     */
+    class iterator
+    {
+    public:
+
+      typedef std::input_iterator_tag iterator_category;
+      typedef T value_type;
+      typedef ptrdiff_t difference_type;
+      typedef const T *pointer;
+      typedef const T& reference;
+
+      iterator(Generator *gen = nullptr) :
+        generator(gen)
+      {
+      }
+
+      const T& operator *() const
+      {
+        return *generator->value;
+      }
+
+      const T *operator ->() const
+      {
+        return generator->value;
+      }
+
+      iterator& operator ++()
+      {
+        generator->fetched = false;
+
+        if(!generator->hasNext())
+        {
+          generator = nullptr;
+        }
+
+        return *this;
+      }
+
+      void operator ++(int)
+      {
+        ++(*this);
+      }
+
+      bool operator == (const iterator& it) const
+      {
+        return generator == it.generator;
+      }
+
+      bool operator != (const iterator& it) const
+      {
+        return generator != it.generator;
+      }
+
+    private:
+
+      Generator *generator;
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param func : the generator body.
+     * @param stackSize : size of the generator stack.
+     * @return a new generator.
+     */
+    Generator(const Function& func, size_t stackSize = 4 * 4096) :
+      function(func), size(stackSize), value(nullptr), fetched(false), stopping(false)
+    {
+    }
+
+    /**
+     * Destructor.
+     * A body paused in yield() is unwound before its stack is released.
+     *
+     * @return
+     */
+    ~Generator()
+    {
+      stop();
+    }
+
+    /**
+     * Produce the next value. Must only be called by the generator body.
+     * The value is not copied, it must remain valid until yield() returns.
+     *
+     * @param val : the produced value.
+     */
+    void yield(const T& val)
+    {
+      value = &val;
+      Coroutine::yield();
+      value = nullptr;
+
+      if(stopping)
+      {
+        throw Stop();
+      }
+    }
+
+    /**
+     * Get an iterator on the next value.
+     *
+     * @return the iterator.
+     */
+    iterator begin()
+    {
+      return hasNext() ? iterator(this) : end();
+    }
+
+    /**
+     * Get the end iterator.
+     *
+     * @return the iterator.
+     */
+    iterator end()
+    {
+      return iterator();
+    }
+
+    /**
+     * Restart the generation from the beginning.
+     *
+     * @return itself
+     */
+    Iterator::Interface<T>& reset()
+    {
+      stop();
+      body = Shared::Pointer<Body>();
+      return *this;
+    }
+
+    /**
+     * Get the next value.
+     * Throw an Iterator::Exception::OutOfRange if the generation is over.
+     *
+     * @return the next value.
+     */
+    T getNext()
+    {
+      if(!hasNext())
+      {
+        Overkiz::Iterator::Exception::OutOfRange e;
+        throw e;
+      }
+
+      fetched = false;
+      return *value;
+    }
+
+    /**
+     * Test if a value is available, run the body until the next value.
+     *
+     * @return false if the generation is over.
+     */
+    bool hasNext()
+    {
+      if(!fetched)
+      {
+        advance();
+        fetched = true;
+      }
+
+      return value != nullptr;
+    }
+
+  private:
+
+    /**
+     * Thrown in the body to unwind it when the generator is stopped.
+     */
+    class Stop
+    {
+    };
+
+    class Body: public Coroutine
+    {
+    public:
+
+      Body(Generator *gen, size_t stackSize) :
+        Coroutine(stackSize), generator(gen)
+      {
+      }
+
+      virtual ~Body()
+      {
+      }
+
+      void entry()
+      {
+        try
+        {
+          if(generator->function)
+          {
+            generator->function(*generator);
+          }
+        }
+        catch(const Stop&)
+        {
+        }
+        catch(...)
+        {
+          error = std::current_exception();
+        }
+
+        generator->value = nullptr;
+      }
+
+      Generator *generator;
+      std::exception_ptr error;
+    };
+
+    Generator(const Generator& generator);
+
+    Generator& operator = (const Generator& generator);
+
+    void advance()
+    {
+      if(body.empty())
+      {
+        body = Shared::Pointer<Body>::create(this, size);
+      }
+      else if(body->status() != Coroutine::Status::PAUSED)
+      {
+        value = nullptr;
+        return;
+      }
+
+      Coroutine::resume(body);
+
+      if(body->error)
+      {
+        std::exception_ptr error = body->error;
+        body->error = nullptr;
+        std::rethrow_exception(error);
+      }
+    }
+
+    void stop()
+    {
+      if(!body.empty() && body->status() == Coroutine::Status::PAUSED)
+      {
+        stopping = true;
+        Coroutine::resume(body);
+        stopping = false;
+
+        //The body caught the unwinding and yielded again, its objects are leaked with its stack
+        if(body->status() == Coroutine::Status::PAUSED)
+        {
+          OVK_ERROR("Generator %p: the body ignored its stop and is released while paused.", this);
+          body = Shared::Pointer<Body>();
+        }
+      }
+
+      value = nullptr;
+      fetched = false;
+    }
+
+    Function function;
+    Shared::Pointer<Body> body;
+    size_t size;
+    const T *value;
+    bool fetched;
+    bool stopping;
+  };
+
+}
+
+#endif /* OVERKIZ_GENERATOR_H_ */
@@ -59,6 +59,8 @@ namespace Overkiz
 
     void process(uint32_t events);
 
+    size_t clients() const;
+
     void watchDirectory(InotifyInstance * inst);
 
     class FileCreated : public InotifyInstance
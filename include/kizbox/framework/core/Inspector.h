@@ -0,0 +1,59 @@
+/*
+ * Inspector.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_INSPECTOR_H_
+#define OVERKIZ_INSPECTOR_H_
+
+#include <signal.h>
+
+#include <kizbox/framework/core/Poller.h>
+#include <kizbox/framework/core/Signal.h>
+
+namespace Overkiz
+{
+
+  /**
+   * Log the snapshot of the poller of a thread on demand, when the process
+   * receives a signal:
+   *   kill -USR2 <pid>
+   * The signal is received through the signal manager of the thread.
+   */
+  class Poller::Inspector: public Signal::Handler
+  {
+  public:
+
+    /**
+     * Constructor.
+     * Inspect the poller of the calling thread.
+     *
+     * @param signal : the signal triggering a dump.
+     * @return a new inspector.
+     */
+    Inspector(uint32_t signal = SIGUSR2);
+
+    /**
+     * Destructor.
+     *
+     * @return
+     */
+    virtual ~Inspector();
+
+  protected:
+
+    void handle(const Overkiz::Signal& signal);
+
+  private:
+
+    Inspector(const Inspector& inspector);
+
+    Inspector& operator = (const Inspector& inspector);
+
+    uint32_t signal;
+  };
+
+}
+
+#endif /* OVERKIZ_INSPECTOR_H_ */
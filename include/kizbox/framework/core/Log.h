@@ -9,9 +9,13 @@
 
 #include <syslog.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string>
 #include <string.h>
 #include <sys/time.h>
+#include <atomic>
+#include <map>
+#include <utility>
 
 #include <kizbox/framework/core/Shared.h>
 #include <kizbox/framework/core/Thread.h>
@@ -44,16 +48,35 @@
 #define LOG_ENABLE_FOREGROUND(level)  Overkiz::Log::Logger::get()->setPrintLevel(level)
 #define LOG_GETCURRENT_FOREGROUND     Overkiz::Log::Logger::get()->getPrintLevel()
 
+/* Messages less important than this level are compiled out, see --with-log-level */
+#ifndef OVK_LOG_COMPILE_LEVEL
+  #define OVK_LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+/* True if the format of a log is a string literal, its arguments can be formatted later */
+#ifdef __GNUC__
+  #define OVK_LOG_FORMAT(format, ...)  format
+  #define OVK_LOG_STATIC(...)          __builtin_constant_p(OVK_LOG_FORMAT(__VA_ARGS__, 0))
+#else
+  #define OVK_LOG_STATIC(...)          0
+#endif
+
+/* Macro to send a log, the arguments are only evaluated if the priority passes the compile time and runtime levels */
+#define OVK_LOG(priority, ...) \
+  ((priority) <= OVK_LOG_COMPILE_LEVEL && Overkiz::Log::Logger::isEnabled(priority) ? \
+   (OVK_LOG_STATIC(__VA_ARGS__) ? Overkiz::Log::Logger::get()->record(priority, __VA_ARGS__) : \
+    Overkiz::Log::Logger::get()->print(priority, __VA_ARGS__)) : (void) 0)
+
 /* Macros to sending log */
 /* These are syslog default level, all levels use MEM and CPU for logging in production builds. use sparingly. */
-#define OVK_EMERGENCY(...)     Overkiz::Log::Logger::get()->print(Overkiz::Log::Priority::OVK_EMERGENCY, __VA_ARGS__)
-#define OVK_ALERT(...)         Overkiz::Log::Logger::get()->print(Overkiz::Log::Priority::OVK_ALERT, __VA_ARGS__)
-#define OVK_CRITICAL(...)      Overkiz::Log::Logger::get()->print(Overkiz::Log::Priority::OVK_CRITICAL, __VA_ARGS__)
-#define OVK_ERROR(...)         Overkiz::Log::Logger::get()->print(Overkiz::Log::Priority::OVK_ERROR, __VA_ARGS__)
-#define OVK_WARNING(...)       Overkiz::Log::Logger::get()->print(Overkiz::Log::Priority::OVK_WARNING, __VA_ARGS__)
-#define OVK_NOTICE(...)        Overkiz::Log::Logger::get()->print(Overkiz::Log::Priority::OVK_NOTICE, __VA_ARGS__)
-#define OVK_INFO(...)          Overkiz::Log::Logger::get()->print(Overkiz::Log::Priority::OVK_INFO, __VA_ARGS__)
-#define OVK_DEBUG(...)         Overkiz::Log::Logger::get()->print(Overkiz::Log::Priority::OVK_DEBUG, __VA_ARGS__)
+#define OVK_EMERGENCY(...)     OVK_LOG(Overkiz::Log::Priority::OVK_EMERGENCY, __VA_ARGS__)
+#define OVK_ALERT(...)         OVK_LOG(Overkiz::Log::Priority::OVK_ALERT, __VA_ARGS__)
+#define OVK_CRITICAL(...)      OVK_LOG(Overkiz::Log::Priority::OVK_CRITICAL, __VA_ARGS__)
+#define OVK_ERROR(...)         OVK_LOG(Overkiz::Log::Priority::OVK_ERROR, __VA_ARGS__)
+#define OVK_WARNING(...)       OVK_LOG(Overkiz::Log::Priority::OVK_WARNING, __VA_ARGS__)
+#define OVK_NOTICE(...)        OVK_LOG(Overkiz::Log::Priority::OVK_NOTICE, __VA_ARGS__)
+#define OVK_INFO(...)          OVK_LOG(Overkiz::Log::Priority::OVK_INFO, __VA_ARGS__)
+#define OVK_DEBUG(...)         OVK_LOG(Overkiz::Log::Priority::OVK_DEBUG, __VA_ARGS__)
 
 /* Macro for debuging purposes, this will not be include in production builds */
 #ifdef HAVE_TRACE
@@ -109,6 +132,23 @@ namespace Overkiz
       OVK_TIME_COUNT,
     };
 
+    /**
+     * Policy of the asynchronous mode when the queue of a thread is full.
+     */
+    enum Overflow
+    {
+      OVK_OVERFLOW_DROP, //!< Drop the message, the drop count is logged later
+      OVK_OVERFLOW_BLOCK, //!< Wait until the drain thread makes room
+    };
+
+    class Ring;
+
+    class Drain;
+
+    class Recorder;
+
+    class Category;
+
     static const std::string PRIORITY_STRING_UC[] = { "EMERGENCY", "ALERT",
                                                       "CRITICAL", "ERROR", "WARNING", "NOTICE", "INFO", "DEBUG", "SILENT",
                                                       "UNKNOWN"
@@ -147,36 +187,240 @@ namespace Overkiz
       #endif
       void print(const std::string & ident, const Overkiz::Log::Priority priority, const char * format, ...);
 
+      /**
+       * Log a message whose format is a string literal.
+       * In binary mode, the raw arguments are queued with the address of the
+       * format and the message is formatted by the drain thread.
+       *
+       * @param priority : the priority of the message.
+       * @param format : a format with static storage duration.
+       */
+      #ifdef __GNUC__
+      __attribute__((format(printf, 3, 4)))
+      #endif
+      void record(const Overkiz::Log::Priority priority, const char * format, ...);
+
       void setFacility(const Overkiz::Log::Priority facility);
 
       void setPrintLevel(const Overkiz::Log::Priority priority);
 
       Overkiz::Log::Priority getPrintLevel() const;
 
+      /**
+       * Set the level of the messages sent to syslog for all the threads.
+       * The default level is OVK_DEBUG, or the OVK_LOG_SYSLOG_LVL
+       * environment variable.
+       *
+       * @param priority : the least important priority sent to syslog.
+       */
+      static void setLevel(const Overkiz::Log::Priority priority);
+
+      static Overkiz::Log::Priority getLevel();
+
+      /**
+       * Check if a message may be logged, before formatting it.
+       * A message passes if it is sent to syslog, if its priority has
+       * ever been printed on the console by a thread, or if a flight
+       * recorder is attached.
+       *
+       * @param priority : the priority of the message.
+       * @return false if the message is discarded.
+       */
+      static bool isEnabled(const Overkiz::Log::Priority priority)
+      {
+        return priority <= threshold.load(std::memory_order_relaxed);
+      }
+
       #ifdef __GNUC__
       __attribute__((format(printf, 3, 0)))
       #endif
       void vprint(const Overkiz::Log::Priority priority, const char * format,
                   va_list arguments);
 
+      /**
+       * Enable or disable the asynchronous mode for all the threads.
+       * In asynchronous mode, a message is formatted by the calling thread
+       * and queued in a lock free ring of its logger. A background thread
+       * writes the queued messages to syslog and to the console, the calling
+       * thread only makes a system call to wake it up when its ring was empty.
+       * Disabling the mode flushes the queued messages.
+       *
+       * @param enabled : true to enable the asynchronous mode.
+       * @param overflow : policy when the ring of a thread is full.
+       * @param capacity : number of messages of the ring of each thread.
+       */
+      static void setAsynchronous(bool enabled, Overkiz::Log::Overflow overflow = OVK_OVERFLOW_DROP,
+                                  size_t capacity = 256);
+
+      static bool isAsynchronous();
+
+      /**
+       * Enable or disable the binary mode for all the threads.
+       * In asynchronous mode, the messages logged by the OVK_* macros are
+       * then queued without being formatted: the record holds the address of
+       * the format, the elapsed time and the raw arguments, strings are
+       * copied. Formats with unsupported conversions are formatted as usual.
+       *
+       * @param enabled : true to enable the binary mode.
+       */
+      static void setBinary(bool enabled);
+
+      static bool isBinary();
+
+      /**
+       * Wait until the queued messages of all the threads are written.
+       */
+      static void flush();
+
+      /**
+       * Limit the rate of the messages of each call site of the OVK_*
+       * macros, identified by its format and its priority. Each site of
+       * each thread has a token bucket: extra messages are dropped before
+       * being formatted and counted in the next message of the site.
+       * The default is the OVK_LOG_RATE environment variable, "rate" or
+       * "rate/burst".
+       *
+       * @param rate : messages per second of a site, 0 for no limit.
+       * @param burst : messages logged in a row, 0 for the rate.
+       */
+      static void setRateLimit(unsigned rate, unsigned burst = 0);
+
+      /**
+       * Fold the consecutive messages of a call site of a thread into a
+       * "Last message repeated N times." message, written when another
+       * message is logged, when the site logs again after a delay, or when
+       * the thread exits. Only the first message of a row is formatted.
+       * The default is the OVK_LOG_REPEAT environment variable.
+       *
+       * @param enabled : true to fold repeated messages.
+       * @param delay : seconds after which a row of repeats is reported.
+       */
+      static void setFolding(bool enabled, unsigned delay = 30);
+
+      /**
+       * Copy the messages of all the levels and all the threads in a flight
+       * recorder, in addition to syslog and the console. The recorder must
+       * be detached before being destroyed by another thread.
+       *
+       * @param recorder : the recorder, nullptr to detach it.
+       */
+      static void setRecorder(Overkiz::Log::Recorder * recorder);
+
+      static Overkiz::Log::Recorder * getRecorder();
+
     private:
 
-      void updateIdent(const std::string & ident);
+      /**
+       * Call site of a message, its format and its priority.
+       */
+      typedef std::pair<const char *, int> Site;
+
+      struct Bucket
+      {
+        double tokens;
+        uint64_t last;
+        unsigned suppressed;
+      };
+
+      /**
+       * Log a message.
+       *
+       * @param constant : true if the format has static storage duration.
+       * @param limit : the level of the category of the message, for syslog
+       * and the console, OVK_UNKNOWN_PRIORITY for the levels of the thread.
+       */
+      #ifdef __GNUC__
+      __attribute__((format(printf, 4, 0)))
+      #endif
+      void log(const std::string * ident, const Overkiz::Log::Priority priority, const char * format,
+               va_list arguments, bool constant = false, int limit = OVK_UNKNOWN_PRIORITY);
+
+      /**
+       * Queue a message in the ring of this logger.
+       *
+       * @param constant : true if the format has static storage duration.
+       * @param logged : true if the message is sent to syslog.
+       * @param console : true if the message is printed on the console.
+       * @return false if the message must be written synchronously.
+       */
+      #ifdef __GNUC__
+      __attribute__((format(printf, 4, 0)))
+      #endif
+      bool enqueue(const std::string * ident, const Overkiz::Log::Priority priority, const char * format,
+                   va_list arguments, bool constant, bool logged, bool console);
+
+      /**
+       * Apply the rate limit and the folding before formatting a message.
+       *
+       * @param constant : true if the format identifies the call site.
+       * @return false if the message is dropped.
+       */
+      bool admit(const Overkiz::Log::Priority priority, const char * format, bool constant);
+
+      /**
+       * Write the count of the folded messages and end the row.
+       */
+      void report();
 
-      void defaultIdent();
+      #ifdef __GNUC__
+      __attribute__((format(printf, 3, 4)))
+      #endif
+      void notify(const Overkiz::Log::Priority priority, const char * format, ...);
+
+      /**
+       * Get the time prefix of a console message.
+       *
+       * @param elapsed : the elapsed time to print.
+       * @return false if console messages are not timed.
+       */
+      bool stamp(struct timeval & elapsed);
+
+      /**
+       * Update the thresholds of isEnabled().
+       *
+       * @param printLevel : a new console print level, OVK_UNKNOWN_PRIORITY if
+       * unchanged.
+       */
+      static void raise(const Overkiz::Log::Priority printLevel);
 
-      void consoleOutput(const Overkiz::Log::Priority priority, const char * format,
-                         va_list arguments);
+      #ifdef __GNUC__
+      __attribute__((format(printf, 3, 0)))
+      #endif
+      static void consoleOutput(const Overkiz::Log::Priority priority, const struct timeval * elapsed,
+                                const char * format, va_list arguments);
 
       unsigned char _facility;
       Overkiz::Log::Priority _printLevel;
       Overkiz::Log::TimedMsg timed;
       int _options;
 
-      std::string _temporaryIdent;
       struct timeval tv1;
+      Ring * ring;
+
+      std::map<Site, Bucket> buckets;
+      Site last;
+      unsigned repeats;
+      uint64_t folded; //!< time of the first folded message of the row
       static Thread::Key<Logger> logger;
 
+      static std::atomic<bool> asynchronous;
+      static std::atomic<bool> binary;
+      static std::atomic<Overkiz::Log::Overflow> overflow;
+      static std::atomic<size_t> capacity;
+
+      static std::atomic<int> level;
+      static std::atomic<int> printed;
+      static std::atomic<int> threshold;
+      static std::atomic<Overkiz::Log::Recorder *> recorder;
+
+      static std::atomic<unsigned> rate;
+      static std::atomic<unsigned> burst;
+      static std::atomic<bool> folding;
+      static std::atomic<unsigned> delay;
+
+      friend class Drain;
+      friend class Category;
+
     };
 
   }
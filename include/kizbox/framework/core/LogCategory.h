@@ -0,0 +1,229 @@
+/*
+ * LogCategory.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_LOG_CATEGORY_H_
+#define OVERKIZ_LOG_CATEGORY_H_
+
+#include <signal.h>
+#include <atomic>
+#include <string>
+
+#include <kizbox/framework/core/Log.h>
+#include <kizbox/framework/core/Pipe.h>
+#include <kizbox/framework/core/Signal.h>
+
+/* Macro to send a log of a category, the arguments are only evaluated if the priority passes the levels */
+#define OVK_CLOG(category, priority, ...) \
+  ((priority) <= OVK_LOG_COMPILE_LEVEL && (category).isEnabled(priority) ? \
+   (OVK_LOG_STATIC(__VA_ARGS__) ? (category).record(priority, __VA_ARGS__) : \
+    (category).print(priority, __VA_ARGS__)) : (void) 0)
+
+#define OVK_CEMERGENCY(category, ...)  OVK_CLOG(category, Overkiz::Log::Priority::OVK_EMERGENCY, __VA_ARGS__)
+#define OVK_CALERT(category, ...)      OVK_CLOG(category, Overkiz::Log::Priority::OVK_ALERT, __VA_ARGS__)
+#define OVK_CCRITICAL(category, ...)   OVK_CLOG(category, Overkiz::Log::Priority::OVK_CRITICAL, __VA_ARGS__)
+#define OVK_CERROR(category, ...)      OVK_CLOG(category, Overkiz::Log::Priority::OVK_ERROR, __VA_ARGS__)
+#define OVK_CWARNING(category, ...)    OVK_CLOG(category, Overkiz::Log::Priority::OVK_WARNING, __VA_ARGS__)
+#define OVK_CNOTICE(category, ...)     OVK_CLOG(category, Overkiz::Log::Priority::OVK_NOTICE, __VA_ARGS__)
+#define OVK_CINFO(category, ...)       OVK_CLOG(category, Overkiz::Log::Priority::OVK_INFO, __VA_ARGS__)
+#define OVK_CDEBUG(category, ...)      OVK_CLOG(category, Overkiz::Log::Priority::OVK_DEBUG, __VA_ARGS__)
+
+namespace Overkiz
+{
+  namespace Log
+  {
+
+    /**
+     * Named category of messages, with its own level.
+     * A category is usually a static object of a module:
+     *   static Overkiz::Log::Category category("zwave");
+     *   OVK_CDEBUG(category, "frame %d", id);
+     * Its level replaces both the syslog level and the console level of
+     * the thread for its messages, the flight recorder is unchanged. A
+     * category without level follows the levels of the thread.
+     *
+     * Levels are set by name, for the categories created later too. The
+     * OVK_LOG_CATEGORIES environment variable holds the initial levels,
+     * e.g. "zwave=debug,io=warning".
+     */
+    class Category
+    {
+    public:
+
+      /**
+       * Constructor.
+       *
+       * @param name : the name of the category, shared by the categories
+       * of different modules with the same name.
+       * @return a new category.
+       */
+      Category(const std::string& name);
+
+      /**
+       * Destructor.
+       *
+       * @return
+       */
+      virtual ~Category();
+
+      const std::string& getName() const;
+
+      Overkiz::Log::Priority getLevel() const;
+
+      /**
+       * Check if a message of the category may be logged, before
+       * formatting it.
+       *
+       * @param priority : the priority of the message.
+       * @return false if the message is discarded.
+       */
+      bool isEnabled(const Overkiz::Log::Priority priority) const
+      {
+        int own = level.load(std::memory_order_relaxed);
+
+        if(own == OVK_UNKNOWN_PRIORITY)
+        {
+          return Logger::isEnabled(priority);
+        }
+
+        //The flight recorder copies all the messages
+        return priority <= own || Logger::recorder.load(std::memory_order_relaxed);
+      }
+
+      #ifdef __GNUC__
+      __attribute__((format(printf, 3, 4)))
+      #endif
+      void print(const Overkiz::Log::Priority priority, const char * format, ...);
+
+      /**
+       * Log a message whose format is a string literal.
+       *
+       * @see Logger::record
+       */
+      #ifdef __GNUC__
+      __attribute__((format(printf, 3, 4)))
+      #endif
+      void record(const Overkiz::Log::Priority priority, const char * format, ...);
+
+      /**
+       * Set the level of the categories of a name.
+       *
+       * @param name : the name of the categories.
+       * @param priority : the least important priority sent to syslog and
+       * printed on the console, OVK_UNKNOWN_PRIORITY to follow the levels
+       * of the thread.
+       */
+      static void setLevel(const std::string& name, const Overkiz::Log::Priority priority);
+
+      /**
+       * Set the levels of categories from a list of "name=level" settings,
+       * separated by commas, spaces or new lines. The level is a priority
+       * name or number, or "default" to follow the levels of the thread.
+       *
+       * @param settings : the settings.
+       * @return false if a setting is invalid, the valid ones are applied.
+       */
+      static bool configure(const std::string& settings);
+
+    private:
+
+      Category(const Category& category);
+
+      Category& operator = (const Category& category);
+
+      std::string name;
+      std::atomic<int> level;
+    };
+
+    /**
+     * Runtime control of the levels of the categories, from the poller of
+     * the calling thread. The settings of Category::configure() are read
+     * from a control fifo:
+     *   echo zwave=debug > /var/run/daemon.fifo
+     * or from a file reloaded when the process receives a signal:
+     *   kill -HUP <pid>
+     */
+    class Control: private Signal::Handler
+    {
+    public:
+
+      /**
+       * Constructor.
+       *
+       * @return a new control, reading nothing.
+       */
+      Control();
+
+      /**
+       * Destructor.
+       *
+       * @return
+       */
+      virtual ~Control();
+
+      /**
+       * Read settings from a fifo, created if needed.
+       * Throw an Overkiz::Errno::Exception if it can't be opened.
+       *
+       * @param path : the path of the fifo, ".fifo" is appended if missing.
+       */
+      void listen(const std::string& path);
+
+      /**
+       * Apply the settings of a file, and again when a signal is received.
+       *
+       * @param path : the path of the file.
+       * @param signal : the signal reloading the file.
+       */
+      void reload(const std::string& path, uint32_t signal = SIGHUP);
+
+    protected:
+
+      void handle(const Overkiz::Signal& signal);
+
+    private:
+
+      class Reader: public Overkiz::Pipe::Listener
+      {
+      public:
+
+        Reader(Control *control);
+
+        virtual ~Reader();
+
+        void notified(Overkiz::Subject<Overkiz::Pipe::Listener> * subject, const uint32_t event);
+
+      private:
+
+        Control *control;
+      };
+
+      Control(const Control& control);
+
+      Control& operator = (const Control& control);
+
+      /**
+       * Apply the complete lines of the received settings.
+       *
+       * @param end : true to apply the last line too.
+       */
+      void apply(bool end);
+
+      void load();
+
+      Overkiz::Pipe::Named::Server fifo;
+      Shared::Pointer<Reader> reader;
+      std::string fifoPath;
+      std::string pending;
+
+      std::string filePath;
+      uint32_t signal;
+    };
+
+  }
+
+}
+
+#endif /* OVERKIZ_LOG_CATEGORY_H_ */
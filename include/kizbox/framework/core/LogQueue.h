@@ -0,0 +1,246 @@
+/*
+ * LogQueue.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_LOG_QUEUE_H_
+#define OVERKIZ_LOG_QUEUE_H_
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <atomic>
+
+#include <kizbox/framework/core/Log.h>
+#include <kizbox/framework/core/LogSink.h>
+
+#define LOG_MAX_IDENT_SIZE 32
+
+namespace Overkiz
+{
+  namespace Log
+  {
+
+    /**
+     * A message queued by the asynchronous mode.
+     * In binary mode, the arguments are formatted by the drain thread.
+     */
+    struct Record
+    {
+      Overkiz::Log::Priority priority;
+      unsigned char facility;
+      int options;
+
+      /**
+       * True if the message is sent to syslog.
+       */
+      bool logged;
+
+      /**
+       * True if the message is printed on the console.
+       */
+      bool console;
+
+      /**
+       * True if the console message is prefixed by its elapsed time.
+       */
+      bool timed;
+      struct timeval elapsed;
+
+      /**
+       * Syslog ident, empty for the default one.
+       */
+      char ident[LOG_MAX_IDENT_SIZE];
+
+      /**
+       * Format of a binary record, nullptr if the text is formatted.
+       */
+      const char *format;
+
+      /**
+       * The formatted message, or the raw arguments of a binary record.
+       */
+      char text[LOG_MAX_MESSAGE_SIZE];
+
+      /**
+       * Store the raw arguments of a format.
+       *
+       * @param format : a format with static storage duration.
+       * @param arguments : its arguments.
+       * @return false if the format has an unsupported conversion or if the
+       * arguments don't fit, the record must then be formatted.
+       */
+      bool encode(const char *format, va_list arguments);
+
+      /**
+       * Format the record.
+       *
+       * @param buffer : the output.
+       * @param size : size of the buffer.
+       * @return the message.
+       */
+      const char *decode(char *buffer, size_t size) const;
+    };
+
+    /**
+     * Lock free ring of records with a single producer, the thread of a
+     * logger, and a single consumer, the drain thread.
+     */
+    class Ring
+    {
+    public:
+
+      /**
+       * Constructor.
+       *
+       * @param capacity : number of records, rounded up to a power of 2.
+       * @return a new empty ring.
+       */
+      Ring(size_t capacity);
+
+      virtual ~Ring();
+
+      /**
+       * Get the next free record, called by the producer.
+       *
+       * @return the record to fill, nullptr if the ring is full.
+       */
+      Record *reserve();
+
+      /**
+       * Publish the reserved record, called by the producer.
+       *
+       * @return true if the consumer had emptied the ring, it must be woken up.
+       */
+      bool commit();
+
+      /**
+       * Get the oldest record, called by the consumer.
+       *
+       * @return the record, nullptr if the ring is empty.
+       */
+      Record *front();
+
+      /**
+       * Release the oldest record, called by the consumer.
+       */
+      void pop();
+
+      bool empty() const;
+
+      /**
+       * Number of records dropped because the ring was full.
+       */
+      std::atomic<size_t> dropped;
+
+      /**
+       * Set when the logger is destroyed, the drain deletes the ring once empty.
+       */
+      std::atomic<bool> closed;
+
+    private:
+
+      Ring(const Ring& ring);
+
+      Ring& operator = (const Ring& ring);
+
+      Record *records;
+      size_t mask;
+      std::atomic<size_t> head;
+      std::atomic<size_t> tail;
+
+      Ring *next;
+
+      friend class Drain;
+    };
+
+    /**
+     * Background thread writing the records of all the rings of the process
+     * to syslog and to the console. Syslog packets are sent by batches.
+     * The thread sleeps until a producer queues a record in an empty ring.
+     */
+    class Drain
+    {
+    public:
+
+      /**
+       * Get the drain of the process, start it on first call.
+       *
+       * @return the drain, nullptr if it is stopped.
+       */
+      static Drain *get();
+
+      /**
+       * Get the drain of the process without starting it.
+       *
+       * @return the drain, nullptr if it isn't running.
+       */
+      static Drain *current();
+
+      /**
+       * Add a ring to drain.
+       *
+       * @param ring : the new ring.
+       */
+      void attach(Ring *ring);
+
+      /**
+       * Wake up the drain thread.
+       */
+      void wake();
+
+      /**
+       * Wait until all the rings are empty.
+       */
+      void flush();
+
+    private:
+
+      Drain();
+
+      virtual ~Drain();
+
+      Drain(const Drain& drain);
+
+      Drain& operator = (const Drain& drain);
+
+      /**
+       * Write the queued records.
+       *
+       * @return true if some records have been written.
+       */
+      bool drain();
+
+      void write(const Record& record);
+
+      #ifdef __GNUC__
+      __attribute__((format(printf, 3, 4)))
+      #endif
+      static void console(const Overkiz::Log::Priority priority, const struct timeval *elapsed,
+                          const char *format, ...);
+
+      void run();
+
+      static void *run(void *drain);
+
+      Thread::Lock lock;
+      Ring *rings;
+      pthread_t thread;
+      int fd;
+      std::atomic<bool> stopping;
+
+      /**
+       * Syslog packets of the records being drained.
+       */
+      Sink::Batch batch;
+
+      static std::atomic<Drain *> instance;
+    };
+
+  }
+
+}
+
+#endif /* OVERKIZ_LOG_QUEUE_H_ */
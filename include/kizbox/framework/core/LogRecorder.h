@@ -0,0 +1,163 @@
+/*
+ * LogRecorder.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_LOG_RECORDER_H_
+#define OVERKIZ_LOG_RECORDER_H_
+
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#include <kizbox/framework/core/Log.h>
+
+#define LOG_RECORDER_MAGIC "OVKFLT1"
+
+namespace Overkiz
+{
+  namespace Log
+  {
+
+    /**
+     * Flight recorder of the messages of all levels.
+     * The messages are copied in a ring of a memory mapped file, on a tmpfs
+     * or pstore file system, without system call. The file keeps the last
+     * messages of a crashed process, and of a rebooted box for pstore. A new
+     * recorder of the same file and size appends to the previous messages.
+     *
+     * A message reserves its entry with an atomic add on the head of the
+     * ring and is committed by a marker written last. Entries overwritten
+     * or torn by a crash are skipped by the readers.
+     */
+    class Recorder
+    {
+    public:
+
+      /**
+       * Constructor.
+       * Throw an Overkiz::Errno::Exception if the file can't be mapped.
+       *
+       * @param path : the ring file, created if needed.
+       * @param size : size of the file.
+       * @return a new recorder.
+       */
+      Recorder(const std::string& path, size_t size = 1024 * 1024);
+
+      /**
+       * Destructor.
+       * Detach the recorder from the loggers and unmap the file.
+       *
+       * @return
+       */
+      virtual ~Recorder();
+
+      /**
+       * Copy a message in the ring.
+       *
+       * @param priority : the priority of the message.
+       * @param ident : the ident of the message, nullptr for the default one.
+       * @param text : the formatted message.
+       */
+      void write(const Overkiz::Log::Priority priority, const char *ident, const char *text);
+
+      /**
+       * Format a message and copy it in the ring.
+       *
+       * @see write
+       */
+      #ifdef __GNUC__
+      __attribute__((format(printf, 4, 0)))
+      #endif
+      void vwrite(const Overkiz::Log::Priority priority, const char *ident, const char *format, va_list arguments);
+
+      /**
+       * Write the recorded messages as text lines, oldest first.
+       * Async signal safe.
+       *
+       * @param fd : the output file descriptor.
+       */
+      void dump(int fd) const;
+
+      /**
+       * Dump the ring on stderr when the process receives a fatal signal:
+       * SIGSEGV, SIGBUS, SIGILL, SIGFPE or SIGABRT. The signal is then raised
+       * again with its default action. The handler runs on an alternate
+       * stack for the calling thread.
+       */
+      void handleFatalSignals();
+
+      /**
+       * Write the recorded messages of a ring file, for the reader utility.
+       *
+       * @param path : the ring file.
+       * @param fd : the output file descriptor.
+       * @return false if the file isn't a ring file.
+       */
+      static bool dump(const std::string& path, int fd);
+
+    private:
+
+      struct Header
+      {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t capacity;
+        std::atomic<uint64_t> head;
+      };
+
+      struct Entry
+      {
+        /**
+         * Size of the entry, a multiple of 8.
+         */
+        uint32_t size;
+
+        /**
+         * Written last, derived from the size and the offset.
+         */
+        uint32_t commit;
+
+        /**
+         * Position of the entry since the creation of the ring.
+         */
+        uint64_t offset;
+
+        /**
+         * Real time in nanoseconds.
+         */
+        uint64_t time;
+        int32_t priority;
+        uint32_t length;
+      };
+
+      Recorder(const Recorder& recorder);
+
+      Recorder& operator = (const Recorder& recorder);
+
+      void copy(uint64_t position, const void *source, size_t size);
+
+      static void copy(const char *data, uint64_t capacity, uint64_t position, void *destination, size_t size);
+
+      static void dump(const Header *header, int fd);
+
+      static uint32_t key(const Entry& entry);
+
+      static void crash(int sig, siginfo_t *info, void *context);
+
+      Header *header;
+      char *data;
+      size_t size;
+
+      static std::atomic<Recorder *> fatal;
+    };
+
+  }
+
+}
+
+#endif /* OVERKIZ_LOG_RECORDER_H_ */
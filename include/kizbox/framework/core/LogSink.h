@@ -0,0 +1,197 @@
+/*
+ * LogSink.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_LOG_SINK_H_
+#define OVERKIZ_LOG_SINK_H_
+
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <atomic>
+
+#include <kizbox/framework/core/Log.h>
+
+#define LOG_SOCKET_PATH "/dev/log"
+
+#define LOG_MAX_PACKET_SIZE (LOG_MAX_MESSAGE_SIZE + 192)
+
+namespace Overkiz
+{
+  namespace Log
+  {
+
+    /**
+     * Connection of the process to the syslog daemon.
+     * The messages are written as syslog packets on a single non blocking
+     * datagram socket connected to /dev/log. The ident is a field of each
+     * packet, threads logging with different idents share the connection.
+     * Packets are formatted by the sink, the time stamp is only formatted
+     * once per second and per thread.
+     */
+    class Sink
+    {
+    public:
+
+      enum Format
+      {
+        RFC3164, //!< <PRI>Mmm dd hh:mm:ss IDENT[PID]: MSG, as glibc
+        RFC5424, //!< <PRI>1 TIMESTAMP HOSTNAME IDENT PID - - MSG
+      };
+
+      enum
+      {
+        BATCH_SIZE = 16,
+      };
+
+      /**
+       * Packets sent with a single system call.
+       */
+      class Batch
+      {
+      public:
+
+        Batch();
+
+        virtual ~Batch();
+
+        /**
+         * Format a message into the next packet.
+         *
+         * @param priority : the facility and the priority of the message.
+         * @param ident : the ident of the message, nullptr or empty for the
+         * program name.
+         * @param options : the openlog() options, only LOG_PID is supported.
+         * @param message : the formatted message.
+         * @return false if the batch is full.
+         */
+        bool add(int priority, const char *ident, int options, const char *message);
+
+        bool empty() const;
+
+        bool full() const;
+
+      private:
+
+        Batch(const Batch& batch);
+
+        Batch& operator = (const Batch& batch);
+
+        char packets[BATCH_SIZE][LOG_MAX_PACKET_SIZE];
+        struct iovec vectors[BATCH_SIZE];
+        struct mmsghdr headers[BATCH_SIZE];
+        size_t count;
+
+        friend class Sink;
+      };
+
+      /**
+       * Get the sink of the process.
+       *
+       * @return the sink.
+       */
+      static Sink& get();
+
+      /**
+       * Send a message to the syslog daemon.
+       * The socket is connected on first use, and reconnected once if the
+       * daemon has been restarted. A full socket is retried for a short
+       * time. The message is dropped if the daemon can't be reached.
+       *
+       * @param priority : the facility and the priority of the message.
+       * @param ident : the ident of the message, nullptr or empty for the
+       * program name.
+       * @param options : the openlog() options, only LOG_PID is supported.
+       * @param message : the formatted message.
+       */
+      void write(int priority, const char *ident, int options, const char *message);
+
+      /**
+       * Format a message directly into a packet and send it.
+       *
+       * @see write
+       */
+      #ifdef __GNUC__
+      __attribute__((format(printf, 5, 0)))
+      #endif
+      void vwrite(int priority, const char *ident, int options, const char *format, va_list arguments);
+
+      /**
+       * Send the packets of a batch with sendmmsg() and empty it.
+       *
+       * @param batch : the packets to send.
+       */
+      void write(Batch& batch);
+
+      /**
+       * Change the socket of the syslog daemon, to log to a local socket in
+       * tests. The next message connects to the new path.
+       *
+       * @param path : path of the unix datagram socket.
+       */
+      void setPath(const std::string& path);
+
+      std::string getPath();
+
+      void setFormat(Format format);
+
+      Format getFormat() const;
+
+    private:
+
+      Sink();
+
+      virtual ~Sink();
+
+      Sink(const Sink& sink);
+
+      Sink& operator = (const Sink& sink);
+
+      /**
+       * Format a syslog packet.
+       *
+       * @return the size of the packet.
+       */
+      #ifdef __GNUC__
+      __attribute__((format(printf, 6, 0)))
+      #endif
+      size_t vformat(char *packet, int priority, const char *ident, int options, const char *format,
+                     va_list arguments);
+
+      #ifdef __GNUC__
+      __attribute__((format(printf, 6, 7)))
+      #endif
+      size_t format(char *packet, int priority, const char *ident, int options, const char *format, ...);
+
+      /**
+       * Send packets.
+       *
+       * @param headers : the packets.
+       * @param count : the number of packets.
+       */
+      void send(struct mmsghdr *headers, size_t count);
+
+      /**
+       * Replace the socket. Once opened, the socket keeps its descriptor
+       * number: a new connection is duplicated over the broken one, as
+       * send() uses the descriptor without the lock.
+       *
+       * @param broken : the socket that failed, -1 if not connected.
+       * @return the new socket, -1 if it can't be connected.
+       */
+      int connect(int broken);
+
+      Thread::Lock lock;
+      std::atomic<int> fd;
+      std::atomic<Format> style;
+      std::string path;
+      std::string hostname;
+    };
+
+  }
+
+}
+
+#endif /* OVERKIZ_LOG_SINK_H_ */
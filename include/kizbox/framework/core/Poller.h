@@ -10,6 +10,13 @@
 #include <errno.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
 
 #include <kizbox/framework/core/Task.h>
 #include <kizbox/framework/core/Thread.h>
@@ -188,6 +195,128 @@ namespace Overkiz
 
     };
 
+    class MigrationException: public Overkiz::Exception
+    {
+    public:
+
+      MigrationException()
+      {
+      }
+
+      virtual ~MigrationException()
+      {
+      }
+
+      virtual const char * getId() const
+      {
+        return "com.overkiz.Framework.Core.Poller.MigrationException";
+      }
+
+    };
+
+    /**
+     * Load balancer sharing the ready tasks of several pollers.
+     * Each poller of the group publishes the length of its ready queue after
+     * each dispatch. A poller whose queue is longer than the shortest one by
+     * more than a threshold moves its migratable tasks to the least loaded
+     * poller (see Task::setMigratable).
+     */
+    class Balancer
+    {
+    public:
+
+      /**
+       * Constructor.
+       *
+       * @param threshold : minimum difference of ready queue lengths to move tasks.
+       * @return a new empty group.
+       */
+      Balancer(size_t threshold = 2);
+
+      /**
+       * Destructor.
+       * The balancer must not be destroyed before the pollers leave it.
+       *
+       * @return
+       */
+      virtual ~Balancer();
+
+      /**
+       * Add the poller of the calling thread to the group.
+       */
+      void join();
+
+      /**
+       * Remove the poller of the calling thread from the group.
+       */
+      void leave();
+
+    private:
+
+      void leave(Poller *poller);
+
+      void share(Poller *poller);
+
+      Thread::Lock lock;
+      std::vector<Poller *> pollers;
+      size_t threshold;
+
+      friend class Poller;
+    };
+
+    class Watchdog;
+
+    class Callback;
+
+    class Inspector;
+
+    /**
+     * State of a registered watcher, see snapshot().
+     */
+    struct Registration
+    {
+      /**
+       * The watcher, it must not be accessed once the snapshot is outdated.
+       */
+      const Watcher *watcher;
+
+      /**
+       * Demangled dynamic type name of the watcher.
+       */
+      std::string type;
+
+      int fd;
+      uint32_t events;
+      int priority;
+      Task::Status status;
+
+      /**
+       * True if the watcher is in the epoll set, false while it is disabled
+       * or its task is paused.
+       */
+      bool polled;
+
+      size_t stackSize;
+
+      /**
+       * Number of timers, events, handlers or watches of a manager.
+       */
+      size_t clients;
+
+      /**
+       * Number of resumes and cumulative time spent in them.
+       */
+      size_t dispatches;
+      Time::Elapsed time;
+
+      /**
+       * Format the registration on one line.
+       *
+       * @return the formatted registration.
+       */
+      std::string toString() const;
+    };
+
     typedef enum
     {
       STOPPED, WAITING, BUSY,
@@ -207,6 +336,42 @@ namespace Overkiz
      */
     void loop(bool daemonize = false);
 
+    /**
+     * Run one iteration of the loop: wait for events at most timeout, then
+     * resume the ready watchers, the scheduled tasks and the callbacks.
+     * Does not wait while some tasks or callbacks are queued.
+     *
+     * @param timeout : maximum waiting time, zero to poll.
+     * @return true if something has been resumed or called.
+     */
+    bool runOnce(const Time::Elapsed& timeout = Time::Elapsed());
+
+    /**
+     * Run the loop for a duration, or until stop() is called or there is
+     * nothing left to watch.
+     *
+     * @param duration : the running time.
+     */
+    void runFor(const Time::Elapsed& duration);
+
+    /**
+     * Run the loop until a predicate is true, or until stop() is called or
+     * there is nothing left to watch. The predicate is checked before each
+     * iteration, an iteration waits for events without timeout.
+     *
+     * @param predicate : the stop condition.
+     */
+    void runUntil(const std::function<bool()>& predicate);
+
+    /**
+     * Get the epoll fd of the poller, to nest it in another event loop.
+     * The fd is readable when runOnce() has something to do, including
+     * the tasks and callbacks left queued by the previous run.
+     *
+     * @return the epoll fd.
+     */
+    int getFd() const;
+
     /**
      * The poller handle the task manager, then you can resume a task with this method
      */
@@ -231,6 +396,119 @@ namespace Overkiz
 
     void stop();
 
+    /**
+     * Set the budget of the tasks resumed by this poller.
+     * A task calling Coroutine::maybeYield() after spending its budget is
+     * paused and resumed after the pending events and the other ready tasks.
+     * Only interruptible tasks can be paused.
+     *
+     * @param time : maximum running time, zero for no time limit.
+     * @param iterations : maximum number of maybeYield() calls, zero for no limit.
+     */
+    void setBudget(const Time::Elapsed& time, size_t iterations = 0);
+
+    /**
+     * Apply a real-time profile to the calling thread, which must be the
+     * thread of this poller: lock the current and future memory of the
+     * process (mlockall) and apply the scheduling policy and priority to the
+     * thread, usually Thread::Scheduler::POLICY_FIFO.
+     * Tasks with bounded latency should also use Task::setRealtime().
+     * Throw a Poller::Exception if the profile can't be applied, it usually
+     * requires CAP_IPC_LOCK and CAP_SYS_NICE.
+     *
+     * @param scheduler : the scheduling policy and parameters of the thread.
+     * @param lockMemory : false to keep the memory of the process unlocked.
+     */
+    void setRealtime(Thread::Scheduler& scheduler, bool lockMemory = true);
+
+    /**
+     * Poll the urgent watchers (see Watcher::setPriority) again before each
+     * dispatch of another watcher, so an urgent event does not wait for the
+     * end of the batch.
+     * It costs a system call per dispatch.
+     *
+     * @param enabled : true to re-poll the urgent watchers.
+     */
+    void setRepoll(bool enabled);
+
+    /**
+     * Run a callback once after the current dispatch batch, before the
+     * poller waits again. A callback deferred by a deferred callback runs
+     * after the next batch. This method must be called by the thread of
+     * this poller, a queued callback is left unchanged.
+     *
+     * @param callback : the callback, owned by the caller.
+     */
+    void defer(Callback& callback);
+
+    /**
+     * Run a callback once when the poller has nothing else to do: no ready
+     * event, no scheduled task and no deferred callback. Queue it again to
+     * run at the next idle time. This method must be called by the thread
+     * of this poller, a queued callback is left unchanged.
+     *
+     * @param callback : the callback, owned by the caller.
+     */
+    void idle(Callback& callback);
+
+    /**
+     * Describe the watchers registered in this poller, including the managers
+     * of timers, events, signals and inotify watches. A watcher is registered
+     * in the poller of the thread which created or last enabled it, until it
+     * is destroyed.
+     * This method must be called by the thread of this poller.
+     *
+     * @return the registered watchers.
+     */
+    std::vector<Registration> snapshot();
+
+    /**
+     * Write the snapshot of this poller, one watcher per line.
+     *
+     * @param file : the output file.
+     */
+    void dump(FILE *file);
+
+    /**
+     * Move a paused task to the poller of another thread.
+     * This method must be called by the thread of this poller. The task, its
+     * coroutine stack and its registrations (watcher, timer, event) are
+     * handed over to the target poller, which restores them when it resumes
+     * the task. A scheduled task stays scheduled, any other paused task must
+     * be resumed by the target thread.
+     * The task must not wait for a synchronization primitive of this thread.
+     * Throw a Poller::MigrationException if the task is not paused or if
+     * one of the pollers does not use interruptible tasks.
+     *
+     * @param task : the paused task to move.
+     * @param target : the poller which takes the task, it must be looping.
+     */
+    void migrate(Task *task, Poller& target);
+
+    /**
+     * Notify a waiter of the thread of this poller.
+     * This method can be called from any thread, the waiter is notified by
+     * the loop of this poller.
+     *
+     * @param waiter : the waiter to notify.
+     */
+    void post(Coroutine::Waiter& waiter);
+
+    /**
+     * Drop a waiter posted and not notified yet, before it is destroyed.
+     * Must be called by the thread of this poller.
+     *
+     * @param waiter : the posted waiter.
+     */
+    void discard(Coroutine::Waiter& waiter);
+
+    /**
+     * Test if the calling thread owns a poller.
+     *
+     * @return true if Poller::get() would not create a new poller.
+     */
+    static bool exists();
+
     void addListener(Daemon::Listener * list);
 
     void removeListener(Daemon::Listener * list);
@@ -261,6 +539,21 @@ namespace Overkiz
 
   private:
 
+    /**
+     * Append a watcher to the registrations, see snapshot().
+     * It must not be registered in another poller.
+     *
+     * @param watcher : the watcher to register.
+     */
+    void track(Watcher *watcher);
+
+    /**
+     * Remove a watcher from the registrations.
+     *
+     * @param watcher : the registered watcher.
+     */
+    void untrack(Watcher *watcher);
+
     /**
      * Constructor.
      *
@@ -275,10 +568,168 @@ namespace Overkiz
      */
     virtual ~Poller();
 
+    /**
+     * Enter the loop in the calling thread.
+     * Throw a Poller::RunningException if the loop is already running.
+     */
+    void begin();
+
+    /**
+     * Leave the loop, keep the epoll fd readable while some work is queued.
+     */
+    void finish();
+
+    /**
+     * Test if the loop has something to watch or to run.
+     *
+     * @return true if the loop must go on.
+     */
+    bool active() const;
+
+    /**
+     * Run one iteration of the loop.
+     *
+     * @param timeout : maximum waiting time in milliseconds, -1 to wait without limit.
+     * @return true if something has been resumed or called.
+     */
+    bool iterate(int timeout);
+
+    /**
+     * Convert a timeout for epoll_wait, rounded up.
+     *
+     * @param time : the timeout.
+     * @return the timeout in milliseconds.
+     */
+    static int milliseconds(const Time::Elapsed& time);
+
+    /**
+     * Resume the tasks scheduled by the task manager.
+     */
+    void dispatch();
+
+    /**
+     * Hand a paused task over to another poller.
+     *
+     * @param task : the paused task.
+     * @param target : the poller which takes the task.
+     * @return false if the task can't be moved.
+     */
+    bool transfer(Task *task, Poller& target);
+
+    /**
+     * Adopt the tasks migrated by other pollers and notify the posted waiters.
+     */
+    void receive();
+
+    /**
+     * Intrusive FIFO of callbacks.
+     */
+    struct Queue
+    {
+      Callback *head;
+      Callback *tail;
+    };
+
+    /**
+     * Queue a callback.
+     *
+     * @param queue : the queue.
+     * @param callback : the callback to append.
+     */
+    void push(Queue& queue, Callback& callback);
+
+    /**
+     * Run the callbacks queued before this call.
+     *
+     * @param queue : the queue.
+     */
+    void flush(Queue& queue);
+
+    /**
+     * Resume a watcher for its events.
+     *
+     * @param watcher : the ready watcher.
+     * @param events : the received events.
+     */
+    void process(Watcher *watcher, uint32_t events);
+
+    /**
+     * Resume the ready urgent watchers, without waiting.
+     */
+    void expedite();
+
+    /**
+     * Get the dispatch rank of an event.
+     *
+     * @param event : the event.
+     * @return the watcher priority, the highest one for the poller events.
+     */
+    int rank(const struct epoll_event& event) const;
+
+    /**
+     * Sort events by decreasing watcher priority, the poller events first.
+     *
+     * @param events : the events.
+     * @param size : the number of events.
+     */
+    void sort(struct epoll_event *events, int size);
+
+    /**
+     * Get the task running in the loop of the calling thread.
+     * Can be called by a signal handler.
+     *
+     * @return the innermost running task, nullptr if none.
+     */
+    static Task *interrupted();
+
+    struct Migration
+    {
+      Task *task;
+      Shared::Pointer<Task::InterruptibleManager::Coroutine> coroutine;
+      bool scheduled;
+    };
+
     Status state;
     int fd;
     int count;
 
+    //Registered watchers, polled or not
+    struct
+    {
+      Thread::Lock lock;
+      Watcher *head;
+      Watcher *tail;
+    } registrations;
+
+    //Watcher resumed by process(), reset if it is destroyed by its task
+    Watcher *dispatching;
+
+    //Poller looping in the calling thread before this one
+    Poller *outer;
+
+    struct
+    {
+      Thread::Lock lock;
+      std::vector<Migration> tasks;
+      std::deque<Coroutine::Waiter *> waiters;
+      int fd;
+    } inbox;
+
+    //Epoll set of the urgent watchers, nested in the main set
+    struct
+    {
+      int fd;
+      bool repoll;
+    } urgent;
+
+    Balancer *balancer;
+    std::atomic<size_t> load;
+
+    Watchdog *watchdog;
+
+    Queue deferred;
+    Queue idlers;
+
     Task::IManager * taskManager;
     bool inter;
     bool abort;
@@ -287,7 +738,59 @@ namespace Overkiz
 
     template<typename T> friend class Shared::Pointer;
     friend class Watcher;
+    friend class Profiler;
+
+  };
+
+  /**
+   * A callback run by the loop of a poller (see Poller::defer and
+   * Poller::idle). The callback is linked in the queue of the poller: queuing
+   * it does not allocate memory nor use any system call.
+   * It runs in the context of the loop, not in a task: it must not pause.
+   */
+  class Poller::Callback
+  {
+  public:
+
+    Callback();
+
+    /**
+     * Destructor.
+     * Cancel the callback if it is queued.
+     *
+     * @return
+     */
+    virtual ~Callback();
+
+    /**
+     * Remove the callback from the queue of its poller.
+     */
+    void cancel();
+
+    /**
+     * Test if the callback waits to be run.
+     *
+     * @return true if the callback is queued.
+     */
+    bool isQueued() const;
+
+  protected:
+
+    /**
+     * Called by the loop of the poller.
+     */
+    virtual void run() = 0;
+
+  private:
+
+    Callback(const Callback& callback);
+
+    Callback& operator = (const Callback& callback);
+
+    Poller::Queue *queue;
+    Callback *next;
 
+    friend class Poller;
   };
 
 }
@@ -0,0 +1,173 @@
+/*
+ * Profiler.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_PROFILER_H_
+#define OVERKIZ_PROFILER_H_
+
+#include <signal.h>
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <string>
+
+#include <kizbox/framework/core/Exception.h>
+
+namespace Overkiz
+{
+
+  /**
+   * Sampling profiler attributing the CPU time of the process to tasks.
+   * An ITIMER_PROF timer sends SIGPROF to the threads consuming CPU. Each
+   * sample records the task running in the poller of the interrupted thread,
+   * its dynamic type and a short stack, in a buffer allocated by the
+   * constructor: the signal handler never allocates memory.
+   *
+   * The samples are written as folded stacks, one line per distinct stack
+   * rooted at the task type, ready for flamegraph.pl:
+   *   MyTimer;Overkiz::Coroutine::launch();MyTimer::expired(...) 42
+   * Frames are named with dladdr(), link the program with -rdynamic to name
+   * its own functions.
+   *
+   * The handler runs on an alternate signal stack for the threads calling
+   * start() or attach(), other threads use the interrupted stack.
+   * Only one profiler can run at a time.
+   */
+  class Profiler
+  {
+  public:
+
+    class Exception: public Overkiz::Exception
+    {
+    public:
+
+      Exception()
+      {
+      }
+
+      virtual ~Exception()
+      {
+      }
+
+      const char *getId() const
+      {
+        return "com.overkiz.Framework.Core.Profiler.Exception";
+      }
+    };
+
+    enum
+    {
+      DEPTH = 16,
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param frequency : number of samples per second of CPU time.
+     * @param capacity : maximum number of samples, later samples are dropped.
+     * @return a new stopped profiler.
+     */
+    Profiler(unsigned frequency = 100, size_t capacity = 16384);
+
+    /**
+     * Destructor.
+     * Stop the profiler.
+     *
+     * @return
+     */
+    virtual ~Profiler();
+
+    /**
+     * Start sampling.
+     * Throw a Profiler::Exception if another profiler is running, an
+     * Overkiz::Errno::Exception if the timer can't be armed.
+     */
+    void start();
+
+    /**
+     * Stop sampling and wait for the handlers still running in other
+     * threads. The samples are kept.
+     */
+    void stop();
+
+    /**
+     * Drop the samples. The profiler must be stopped.
+     */
+    void clear();
+
+    /**
+     * Get the number of recorded samples.
+     *
+     * @return the number of samples.
+     */
+    size_t samples() const;
+
+    /**
+     * Get the number of samples dropped because the buffer was full.
+     *
+     * @return the number of dropped samples.
+     */
+    size_t dropped() const;
+
+    /**
+     * Count the samples of each task type.
+     *
+     * @return the demangled task types and their number of samples.
+     */
+    std::map<std::string, size_t> types() const;
+
+    /**
+     * Write the samples as folded stacks.
+     *
+     * @param file : the output file.
+     */
+    void write(FILE *file) const;
+
+    /**
+     * Run the signal handler of the calling thread on an alternate stack,
+     * for threads whose tasks have small stacks.
+     */
+    static void attach();
+
+  private:
+
+    struct Sample
+    {
+      const char *type;
+      void *frames[DEPTH];
+      int depth;
+      std::atomic<bool> ready;
+    };
+
+    Profiler(const Profiler& profiler);
+
+    Profiler& operator = (const Profiler& profiler);
+
+    /**
+     * Fold the ready samples.
+     *
+     * @return the folded stacks and their number of samples.
+     */
+    std::map<std::string, size_t> fold() const;
+
+    static void sample(int sig, siginfo_t *info, void *context);
+
+    static std::string name(const char *type);
+
+    Sample *buffer;
+    size_t capacity;
+    unsigned frequency;
+    std::atomic<size_t> next;
+    std::atomic<size_t> lost;
+    struct sigaction previous;
+    bool running;
+
+    static std::atomic<Profiler *> active;
+    static std::atomic<int> handlers; //!< signal handlers running
+  };
+
+}
+
+#endif /* OVERKIZ_PROFILER_H_ */
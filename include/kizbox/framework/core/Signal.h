@@ -64,6 +64,8 @@ namespace Overkiz
 
       void process(uint32_t events);
 
+      size_t clients() const;
+
       static Manager & get();
 
       void willFork();
@@ -0,0 +1,246 @@
+/*
+ * Synchronization.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_SYNCHRONIZATION_H_
+#define OVERKIZ_SYNCHRONIZATION_H_
+
+#include <pthread.h>
+
+#include <kizbox/framework/core/Coroutine.h>
+#include <kizbox/framework/core/Thread.h>
+
+namespace Overkiz
+{
+
+  class Poller;
+
+  /**
+   * Base of the coroutine synchronization primitives.
+   * It holds a thread safe FIFO of paused coroutines. Only the waiting
+   * coroutine is paused, never its thread: a coroutine woken by another
+   * thread is notified through the poller of its own thread.
+   */
+  class Coroutine::Synchronizer
+  {
+  public:
+
+    virtual ~Synchronizer();
+
+  protected:
+
+    /**
+     * A paused coroutine, allocated on its stack.
+     * A node unlinks itself when its coroutine is unwound while waiting, and
+     * passes on what was handed over to it if it was already woken up.
+     */
+    struct Node
+    {
+      Node(Synchronizer& owner, Waiter& waiter);
+
+      ~Node();
+
+      Synchronizer *owner;
+      Waiter *waiter;
+      Poller *poller;
+      pthread_t thread;
+      Node *prev;
+      Node *next;
+      bool queued; //!< true while in the FIFO, protected by the guard
+      bool waiting; //!< true until the coroutine is woken up, only used by its thread
+    };
+
+    Synchronizer();
+
+    /**
+     * Append a node. The guard must be acquired.
+     *
+     * @param node : the node to append.
+     */
+    void push(Node& node);
+
+    /**
+     * Remove the first node and hand it over. A node of another thread is
+     * notified now through its poller. The guard must be acquired.
+     *
+     * @param local : the waiter of this thread to wake once the guard is
+     * released, nullptr if none.
+     * @return false if nobody waits.
+     */
+    bool pop(Waiter *& local);
+
+    /**
+     * Pause the running coroutine until its node is handed over.
+     *
+     * @param node : the pushed node of the running coroutine.
+     */
+    void suspend(Node& node);
+
+    /**
+     * Wake up a waiter of this thread removed by pop(). The guard must be
+     * released.
+     *
+     * @param local : the waiter, nullptr if none.
+     */
+    static void wake(Waiter *local);
+
+    /**
+     * Pass on what was handed over to a coroutine unwound before using it.
+     * The guard must be released.
+     */
+    virtual void handOver() = 0;
+
+    Thread::Lock guard;
+
+  private:
+
+    Synchronizer(const Synchronizer& sync);
+
+    Synchronizer& operator = (const Synchronizer& sync);
+
+    /**
+     * Remove a node from the FIFO. The guard must be acquired.
+     *
+     * @param node : the queued node.
+     */
+    void unlink(Node& node);
+
+    Node *head;
+    Node *tail;
+  };
+
+  /**
+   * Mutual exclusion between coroutines of one or several threads.
+   * A coroutine which waits for the mutex is paused, the mutex is handed
+   * over directly to the first waiting coroutine on unlock.
+   */
+  class Coroutine::Mutex: public Coroutine::Synchronizer
+  {
+  public:
+
+    Mutex();
+
+    virtual ~Mutex();
+
+    /**
+     * Lock the mutex, pause the running coroutine while the mutex is locked.
+     * Throw a Coroutine::Exception if the mutex is locked and the running
+     * context is not a coroutine.
+     */
+    void lock();
+
+    /**
+     * Lock the mutex without waiting.
+     *
+     * @return false if the mutex is already locked.
+     */
+    bool tryLock();
+
+    /**
+     * Unlock the mutex, or hand it over to the first waiting coroutine.
+     */
+    void unlock();
+
+  protected:
+
+    void handOver();
+
+  private:
+
+    bool locked;
+  };
+
+  /**
+   * Condition variable between coroutines of one or several threads.
+   */
+  class Coroutine::Condition: public Coroutine::Synchronizer
+  {
+  public:
+
+    Condition();
+
+    virtual ~Condition();
+
+    /**
+     * Unlock the mutex and pause the running coroutine until notified,
+     * then lock the mutex again. If the coroutine is unwound while
+     * paused, the mutex is left unlocked and a notification it received
+     * is passed on to the next waiting coroutine.
+     *
+     * @param mutex : the locked mutex.
+     */
+    void wait(Mutex& mutex);
+
+    /**
+     * Wake the first waiting coroutine.
+     *
+     * @return true if a coroutine has been woken up.
+     */
+    bool notify();
+
+    /**
+     * Wake all waiting coroutines.
+     */
+    void notifyAll();
+
+  protected:
+
+    void handOver();
+  };
+
+  /**
+   * Counting semaphore between coroutines of one or several threads.
+   * A released unit is handed over directly to the first waiting coroutine.
+   */
+  class Coroutine::Semaphore: public Coroutine::Synchronizer
+  {
+  public:
+
+    /**
+     * Constructor.
+     *
+     * @param count : the initial number of units.
+     * @return a new semaphore.
+     */
+    Semaphore(size_t count = 0);
+
+    virtual ~Semaphore();
+
+    /**
+     * Take a unit, pause the running coroutine while there is none.
+     */
+    void acquire();
+
+    /**
+     * Take a unit without waiting.
+     *
+     * @return false if there is no unit.
+     */
+    bool tryAcquire();
+
+    /**
+     * Give a unit back, or hand it over to the first waiting coroutine.
+     */
+    void release();
+
+    /**
+     * Get the number of available units.
+     *
+     * @return the number of units.
+     */
+    size_t value();
+
+  protected:
+
+    void handOver();
+
+  private:
+
+    size_t count;
+  };
+
+}
+
+#endif /* OVERKIZ_SYNCHRONIZATION_H_ */
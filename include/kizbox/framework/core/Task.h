@@ -10,7 +10,9 @@
 #include <map>
 
 #include <kizbox/framework/core/Coroutine.h>
+#include <kizbox/framework/core/Exception.h>
 #include <kizbox/framework/core/Shared.h>
+#include <kizbox/framework/core/Time.h>
 
 namespace Overkiz
 {
@@ -23,6 +25,28 @@ namespace Overkiz
   {
   public:
 
+    /**
+     * Thrown in a cancelled task at its next suspension point.
+     * It must not be caught by the task, or it must be thrown again.
+     */
+    class CancelledException: public Overkiz::Exception
+    {
+    public:
+
+      CancelledException()
+      {
+      }
+
+      virtual ~CancelledException()
+      {
+      }
+
+      const char *getId() const
+      {
+        return "com.overkiz.Framework.Core.Task.CancelledException";
+      }
+    };
+
     /**
      * Task Manager interface, it manage tasks resume
      */
@@ -47,6 +71,94 @@ namespace Overkiz
       {
       }
 
+      /**
+       * Unwind a paused task being destroyed, as if it was cancelled, so
+       * that its stack leaves the queues it waits for.
+       *
+       * @param task : the paused task.
+       */
+      virtual void unwind(Task *task)
+      {
+      }
+
+      /**
+       * Schedule a paused task.
+       * The task is resumed by the next call to dispatch.
+       *
+       * @param task : the task to schedule.
+       */
+      virtual void schedule(Task *task)
+      {
+      }
+
+      /**
+       * Resume the tasks scheduled before this call.
+       */
+      virtual void dispatch()
+      {
+      }
+
+      /**
+       * Test if some tasks are scheduled.
+       *
+       * @return true if some tasks wait to be dispatched.
+       */
+      virtual bool pending() const
+      {
+        return false;
+      }
+
+      /**
+       * Set the budget of a task between two dispatches.
+       * Once the budget is spent, Coroutine::maybeYield() pauses the running
+       * task and schedules it after the other ready tasks.
+       *
+       * @param time : maximum running time, zero for no time limit.
+       * @param iterations : maximum number of maybeYield() calls, zero for no limit.
+       */
+      virtual void setBudget(const Time::Elapsed& time, size_t iterations)
+      {
+      }
+
+      /**
+       * Cancel a running or paused task.
+       *
+       * @param task : the task to cancel.
+       * @return false if the task can't be cancelled.
+       */
+      virtual bool cancel(Task *task)
+      {
+        return false;
+      }
+
+      /**
+       * Watch the deadline of a task.
+       *
+       * @param task : the task with a deadline.
+       */
+      virtual void watch(Task *task)
+      {
+      }
+
+      /**
+       * Stop watching the deadline of a task.
+       *
+       * @param task : the task with a deadline.
+       */
+      virtual void unwatch(Task *task)
+      {
+      }
+
+      /**
+       * Get the running task.
+       *
+       * @return the innermost task being resumed, nullptr if none.
+       */
+      virtual Task *current() const
+      {
+        return nullptr;
+      }
+
     };
 
     /**
@@ -67,9 +179,11 @@ namespace Overkiz
 
       void remove(Task *task);
 
+      Task *current() const;
+
     private:
       bool isRemoved;
-      Task *current;
+      Task *running;
     };
 
     /**
@@ -90,6 +204,24 @@ namespace Overkiz
 
       void remove(Task *task);
 
+      void unwind(Task *task);
+
+      void schedule(Task *task);
+
+      void dispatch();
+
+      bool pending() const;
+
+      void setBudget(const Time::Elapsed& time, size_t iterations);
+
+      bool cancel(Task *task);
+
+      void watch(Task *task);
+
+      void unwatch(Task *task);
+
+      Task *current() const;
+
     protected:
 
       void reset();
@@ -100,7 +232,7 @@ namespace Overkiz
       {
       public:
 
-        Coroutine(size_t stkSize);
+        Coroutine(size_t stkSize, unsigned options);
 
         virtual ~Coroutine();
 
@@ -110,19 +242,106 @@ namespace Overkiz
 
         void restore();
 
+        void resumed();
+
+        bool reschedule();
+
+        bool preempt();
+
       private:
 
         Task *task;
+        InterruptibleManager *manager;
+        bool cancelled;
 
         friend class Task;
       };
 
+      /**
+       * Single timer of the manager, cancelling the tasks whose deadline is reached.
+       */
+      class Deadline;
+
+      void run(Task *task, Shared::Pointer<Coroutine> *current);
+
+      /**
+       * Create a coroutine matching the stack size and options of a task.
+       *
+       * @param task : the task.
+       * @return a new coroutine.
+       */
+      static Shared::Pointer<Coroutine> create(Task *task);
+
+      /**
+       * Cancel the tasks whose deadline is reached and rearm the timer.
+       */
+      void expire();
+
+      bool exhausted();
+
+      /**
+       * Remove a task from the ready list.
+       *
+       * @param task : the scheduled task.
+       */
+      void unschedule(Task *task);
+
+      /**
+       * Give up a paused task and its coroutine.
+       *
+       * @param task : the paused task.
+       * @param coroutine : the coroutine of the task.
+       * @param wasScheduled : true if the task was scheduled.
+       * @return false if the task can't be released.
+       */
+      bool release(Task *task, Shared::Pointer<Coroutine>& coroutine, bool& wasScheduled);
+
+      /**
+       * Take ownership of a paused task released by another manager.
+       *
+       * @param task : the paused task.
+       * @param coroutine : the coroutine of the task.
+       * @param wasScheduled : true to schedule the task.
+       */
+      void adopt(Task *task, Shared::Pointer<Coroutine>& coroutine, bool wasScheduled);
+
+      /**
+       * Find the last scheduled task which may be moved to another manager.
+       *
+       * @return the task, nullptr if none.
+       */
+      Task *migratable() const;
+
       std::map<Task *, Shared::Pointer<Coroutine>> coroutines;
 
+      std::multimap<Time::Monotonic, Task *> deadlines;
+      Deadline *timer;
+
       bool isRemoved;
       Task *currentTask;
 
+      struct
+      {
+        Task *head;
+        Task *tail;
+        Task *last;
+        size_t length;
+      } ready;
+
+      struct
+      {
+        Time::Elapsed time;
+        size_t iterations;
+      } budget;
+
+      struct
+      {
+        Time::Monotonic start;
+        size_t iterations;
+      } slice;
+
       friend class Task;
+      friend class Poller;
 
     };
 
@@ -145,6 +364,8 @@ namespace Overkiz
 
     /**
      * Destructor.
+     * A paused interruptible task is unwound first, like a cancelled one,
+     * but only the hooks of this class are called.
      *
      * @return
      */
@@ -164,6 +385,24 @@ namespace Overkiz
      */
     size_t getStackSize() const;
 
+    /**
+     * Give the task a real-time stack, with an interruptible task manager.
+     * The stack is prefaulted when it is created and kept between two
+     * launches of the task, so the task does not page fault on its stack.
+     * Applies to the next launch of the task.
+     *
+     * @param enabled : true to enable the real-time stack.
+     * @param locked : true to also lock the stack in memory.
+     */
+    void setRealtime(bool enabled, bool locked = false);
+
+    /**
+     * Test if the task has a real-time stack.
+     *
+     * @return true if the real-time stack is enabled.
+     */
+    bool isRealtime() const;
+
     /**
      * Get task status.
      *
@@ -190,6 +429,62 @@ namespace Overkiz
      */
     bool isEnabled();
 
+    /**
+     * Allow the poller load balancer to move this task to another thread
+     * while it is paused and scheduled.
+     * A migratable task must not share data with other tasks of its thread.
+     *
+     * @param allowed : true to allow migration.
+     */
+    void setMigratable(bool allowed);
+
+    /**
+     * Test if the task can be moved by the poller load balancer.
+     *
+     * @return true if migration is allowed.
+     */
+    bool isMigratable() const;
+
+    /**
+     * Cancel this task.
+     * A paused interruptible task is scheduled and a CancelledException is
+     * thrown at its suspension point, a running one throws it at its next
+     * suspension point or Coroutine::maybeYield(). Once its stack has been
+     * unwound, its coroutine is released and cancelled() is called.
+     * The stack of the task must be large enough to throw an exception.
+     *
+     * @return false if the task is idle or not interruptible.
+     */
+    bool cancel();
+
+    /**
+     * Test if a cancellation is pending.
+     *
+     * @return true if the task has been cancelled and not unwound yet.
+     */
+    bool isCancelled() const;
+
+    /**
+     * Set an absolute deadline. The task is cancelled if it is still running
+     * or paused when the deadline is reached.
+     * Deadlines are checked by a single timer of the task manager.
+     *
+     * @param time : the absolute monotonic deadline.
+     */
+    void setDeadline(const Time::Monotonic& time);
+
+    /**
+     * Remove the deadline.
+     */
+    void clearDeadline();
+
+    /**
+     * Test if the task has a deadline.
+     *
+     * @return true if a deadline is set.
+     */
+    bool hasDeadline() const;
+
   protected:
 
     /**
@@ -213,14 +508,40 @@ namespace Overkiz
     {
     }
 
+    /**
+     * Called once a cancelled task has been unwound.
+     */
+    virtual void cancelled()
+    {
+    }
+
   private:
+
+    /**
+     * Get the coroutine stack options of the task.
+     *
+     * @return a combination of Coroutine::Option values.
+     */
+    unsigned stackOptions() const;
+
     size_t stackSize;
+    bool realtime;
+    bool locked;
     Status state;
 
     IManager * manager;
 
     bool enabled;
 
+    bool scheduled;
+    bool movable;
+    Task *next;
+
+    bool cancelling;
+    bool limited;
+    bool watched;
+    Time::Monotonic deadline;
+
     friend class Manager;
   };
 
@@ -138,6 +138,23 @@ namespace Overkiz
        */
       static Real now();
 
+      /**
+       * Function used to get the current time at the resolution of the
+       * kernel tick, without reading the hardware clock.
+       *
+       * @return the current time.
+       */
+      static Real coarse();
+
+      /**
+       * Function used to get the time of the current iteration of the
+       * poller of the thread, the current time outside of a loop.
+       *
+       * @see Clock
+       * @return the time of the iteration.
+       */
+      static Real cached();
+
       /**
        * Function used to retrieve this time in Elapsed time format
        * (time elpased since epoch).
@@ -320,6 +337,32 @@ namespace Overkiz
        */
       static Monotonic now();
 
+      /**
+       * Function used to get the current time at the resolution of the
+       * kernel tick, without reading the hardware clock.
+       *
+       * @return the current time.
+       */
+      static Monotonic coarse();
+
+      /**
+       * Function used to get the time of the current iteration of the
+       * poller of the thread, the current time outside of a loop.
+       *
+       * @see Clock
+       * @return the time of the iteration.
+       */
+      static Monotonic cached();
+
+      /**
+       * Function used to get the current time from the cycle counter when
+       * enabled. Only the difference of two fast times is meaningful.
+       *
+       * @see Clock::setCounter
+       * @return the current time.
+       */
+      static Monotonic fast();
+
       /**
        * Function used to retrieve this time in Elapsed time format
        * (time elpased since the computer startup).
@@ -61,6 +61,8 @@ namespace Overkiz
 
         void process(uint32_t evts);
 
+        size_t clients() const;
+
         static Thread::Key<Manager> manager;
 
         void reschedule();
@@ -142,6 +144,8 @@ namespace Overkiz
 
         void process(uint32_t evts);
 
+        size_t clients() const;
+
         static Thread::Key<Manager> manager;
 
         void reschedule();
@@ -0,0 +1,156 @@
+/*
+ * Watchdog.h
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#ifndef OVERKIZ_WATCHDOG_H_
+#define OVERKIZ_WATCHDOG_H_
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <atomic>
+
+#include <kizbox/framework/core/Poller.h>
+#include <kizbox/framework/core/Time.h>
+
+namespace Overkiz
+{
+
+  /**
+   * Watchdog of the poller of a thread.
+   * A dedicated thread checks the duration of the current dispatch of the
+   * poller. When a task blocks the loop longer than a threshold, the stack of
+   * the poller thread is captured by a signal handler and reported once,
+   * with the blocking task, through the delegate or the log.
+   *
+   * The watchdog uses the SIGRTMIN + 1 signal. Its handler is installed with
+   * SA_RESTART but a blocked system call of the task may still fail with EINTR.
+   * The handler runs on an alternate signal stack, task stacks may be small.
+   */
+  class Poller::Watchdog
+  {
+  public:
+
+    enum
+    {
+      DEPTH = 32,
+    };
+
+    /**
+     * A blocked dispatch.
+     */
+    struct Report
+    {
+      /**
+       * The blocking task, nullptr if unknown.
+       */
+      Task *task;
+
+      /**
+       * Mangled dynamic type name of the task, nullptr if unknown.
+       */
+      const char *type;
+
+      /**
+       * Time spent in the dispatch when the stack was captured.
+       */
+      Time::Elapsed elapsed;
+
+      /**
+       * Return addresses of the poller thread, innermost first.
+       */
+      void *frames[DEPTH];
+      int depth;
+    };
+
+    class Delegate
+    {
+    public:
+
+      virtual ~Delegate()
+      {
+      }
+
+      /**
+       * Called by the watchdog thread for each blocked dispatch.
+       * The task must not be accessed, it may be running.
+       *
+       * @param report : the blocked dispatch.
+       */
+      virtual void blocked(const Report& report) = 0;
+    };
+
+    /**
+     * Constructor.
+     * Watch the poller of the calling thread.
+     * Throw an Overkiz::Errno::Exception if the thread can't be created.
+     *
+     * @param threshold : maximum duration of a dispatch.
+     * @param delegate : receives the reports, nullptr to log them.
+     * @return a new running watchdog.
+     */
+    Watchdog(const Time::Elapsed& threshold, Delegate *delegate = nullptr);
+
+    /**
+     * Destructor.
+     * Stop the watchdog thread. Must be called by the thread of the poller.
+     *
+     * @return
+     */
+    virtual ~Watchdog();
+
+    /**
+     * Log a report with its symbolized stack.
+     *
+     * @param report : the report to log.
+     */
+    static void log(const Report& report);
+
+  private:
+
+    Watchdog(const Watchdog& watchdog);
+
+    Watchdog& operator = (const Watchdog& watchdog);
+
+    /**
+     * Mark the beginning of a dispatch, called by the poller thread.
+     *
+     * @param task : the resumed task, nullptr if unknown.
+     */
+    void enter(Task *task);
+
+    /**
+     * Mark the end of a dispatch, called by the poller thread.
+     */
+    void leave();
+
+    void watch();
+
+    static void *run(void *watchdog);
+
+    static void capture(int sig, siginfo_t *info, void *context);
+
+    static uint64_t now();
+
+    Poller *poller;
+    Delegate *delegate;
+    uint64_t threshold;
+    pthread_t target;
+    pthread_t thread;
+    int fd;
+    void *altStack;
+
+    std::atomic<uint64_t> since;
+    std::atomic<uint32_t> generation;
+    std::atomic<Task *> task;
+    std::atomic<bool> captured;
+    Report sample;
+
+    friend class Poller;
+  };
+
+}
+
+#endif /* OVERKIZ_WATCHDOG_H_ */
@@ -68,6 +68,24 @@ namespace Overkiz
 
     void stop();
 
+    /**
+     * Set the dispatch priority of the watcher.
+     * The watchers ready in the same poll are resumed by decreasing priority.
+     * Watchers with a positive priority are urgent: they are polled before
+     * the others and, if the poller re-polls them (see Poller::setRepoll),
+     * between two dispatches of other watchers.
+     *
+     * @param priority : the priority, 0 by default.
+     */
+    void setPriority(int priority);
+
+    /**
+     * Get the dispatch priority of the watcher.
+     *
+     * @return the priority.
+     */
+    int getPriority() const;
+
   protected:
 
     Watcher();
@@ -88,6 +106,17 @@ namespace Overkiz
 
     virtual void cleanup();
 
+    /**
+     * Get the number of clients of the watcher, for introspection.
+     * The managers count their timers, events, signal handlers or watches.
+     *
+     * @return the number of clients, 0 by default.
+     */
+    virtual size_t clients() const
+    {
+      return 0;
+    }
+
     uint32_t events;
     int fd;
 
@@ -95,8 +124,28 @@ namespace Overkiz
 
     void entry();
 
+    /**
+     * Move this watcher to the registrations of a poller.
+     *
+     * @param poller : the poller, nullptr to unregister.
+     */
+    void track(Poller *poller);
+
     Shared::Pointer<Poller> manager;
     uint32_t current;
+    int priority;
+    bool polled;
+
+    //Registrations of a poller, kept while the task is paused
+    Poller *registry;
+    Watcher *prev;
+    Watcher *next;
+
+    struct
+    {
+      size_t dispatches;
+      Time::Elapsed time;
+    } statistics;
 
     friend class Poller;
     template<typename T> friend class Shared::Pointer;
@@ -4,12 +4,22 @@
  *      Copyright (C) 2015 Overkiz SA.
  */
 
+#include <errno.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
 
 #include "Log.h"
+#include "LogQueue.h"
+#include "LogRecorder.h"
+#include "LogSink.h"
 
 #define LOG_ENVNAME_LEVEL             "OVK_LOG_LVL"
 #define LOG_ENVNAME_TIME              "OVK_LOG_TIME"
+#define LOG_ENVNAME_SYSLOG_LEVEL      "OVK_LOG_SYSLOG_LVL"
+#define LOG_ENVNAME_RATE              "OVK_LOG_RATE"
+#define LOG_ENVNAME_REPEAT            "OVK_LOG_REPEAT"
 
 namespace Overkiz
 {
@@ -17,6 +27,23 @@ namespace Overkiz
   namespace Log
   {
 
+    namespace
+    {
+
+      /**
+       * Get the time of the rate limit and of the folding.
+       *
+       * @return CLOCK_MONOTONIC_COARSE in ns.
+       */
+      uint64_t coarse()
+      {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+        return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+      }
+
+    }
+
     Overkiz::Shared::Pointer<Overkiz::Log::Logger> & Logger::get()
     {
       if(logger->empty())
@@ -28,9 +55,41 @@ namespace Overkiz
     }
 
     Logger::Logger() :
-      _facility(LOG_DAEMON), _printLevel(Priority::OVK_ERROR), _options(0), timed(OVK_TIME_UNKNOWN)
+      _facility(LOG_DAEMON), _printLevel(Priority::OVK_ERROR), _options(0), timed(OVK_TIME_UNKNOWN),
+      ring(nullptr), last(nullptr, OVK_UNKNOWN_PRIORITY), repeats(0), folded(0)
     {
-      openlog(NULL, _options, _facility);
+      static bool configured = false;
+
+      //The syslog level and the limits are shared, they are only read by the first logger
+      if(!configured)
+      {
+        const char * envs = getenv(LOG_ENVNAME_SYSLOG_LEVEL);
+        const char * envr = getenv(LOG_ENVNAME_RATE);
+        const char * envf = getenv(LOG_ENVNAME_REPEAT);
+        configured = true;
+
+        if(envs != NULL)
+        {
+          Overkiz::Log::Priority prio = Overkiz::Log::Logger::getPriority(envs);
+
+          if(prio != Overkiz::Log::Priority::OVK_UNKNOWN_PRIORITY)
+            setLevel(prio);
+        }
+
+        if(envr != NULL)
+        {
+          unsigned r = 0, b = 0;
+
+          if(sscanf(envr, "%8u/%8u", &r, &b) >= 1)
+            setRateLimit(r, b);
+        }
+
+        if(envf != NULL)
+        {
+          setFolding(atoi(envf) != 0);
+        }
+      }
+
       const char * envl = getenv(LOG_ENVNAME_LEVEL);
       const char * envt = getenv(LOG_ENVNAME_TIME);
 
@@ -42,6 +101,8 @@ namespace Overkiz
           _printLevel = prio;
       }
 
+      raise(_printLevel);
+
       if(envt != NULL)
       {
         timed = Overkiz::Log::Logger::getTimed(envt);
@@ -55,7 +116,23 @@ namespace Overkiz
 
     Logger::~Logger()
     {
-      closelog();
+      //The thread ends with a row of repeats
+      if(repeats)
+      {
+        report();
+      }
+
+      //The drain deletes the ring once written
+      if(ring)
+      {
+        ring->closed = true;
+        Drain *drain = Drain::current();
+
+        if(drain)
+        {
+          drain->wake();
+        }
+      }
     }
 
     Overkiz::Log::Priority Logger::getPriority(const std::string & priority)
@@ -106,76 +183,215 @@ namespace Overkiz
       return OVK_TIME_UNKNOWN;
     }
 
-    void Logger::updateIdent(const std::string & ident)
+    void Logger::print(const Overkiz::Log::Priority priority, const char * format, ...)
     {
-      closelog();
-      _temporaryIdent = ident;
-      openlog(_temporaryIdent.c_str(), _options, _facility);
+      va_list arguments;
+      va_start(arguments, format);
+      log(nullptr, priority, format, arguments);
+      va_end(arguments);
     }
 
-    void Logger::defaultIdent()
+    void Logger::vprint(const Overkiz::Log::Priority priority, const char * format,
+                        va_list arguments)
     {
-      closelog();
-      _temporaryIdent.clear();
-      openlog(NULL, _options, _facility);
+      log(nullptr, priority, format, arguments);
     }
 
-    void Logger::print(const Overkiz::Log::Priority priority, const char * format, ...)
+    void Logger::print(const std::string & ident, const Overkiz::Log::Priority priority,  const char * format, ...)
     {
-      if(!_temporaryIdent.empty())
-      {
-        defaultIdent();
-      }
+      va_list arguments;
+      va_start(arguments, format);
+      log(&ident, priority, format, arguments);
+      va_end(arguments);
+    }
 
+    void Logger::record(const Overkiz::Log::Priority priority, const char * format, ...)
+    {
       va_list arguments;
       va_start(arguments, format);
-      vsyslog(LOG_MAKEPRI(_facility, priority), format, arguments);
+      log(nullptr, priority, format, arguments, true);
       va_end(arguments);
+    }
+
+    void Logger::log(const std::string * ident, const Overkiz::Log::Priority priority, const char * format,
+                     va_list arguments, bool constant, int limit)
+    {
+      //Like syslog, logging keeps errno, which is also needed by each %m conversion
+      int error = errno;
+      int print = _printLevel;
+
+      //The level of a category replaces both the syslog level and the console level
+      if(limit == OVK_UNKNOWN_PRIORITY)
+      {
+        limit = level.load(std::memory_order_relaxed);
+      }
+      else
+      {
+        print = limit;
+      }
+
+      bool logged = priority <= limit || priority <= print;
+      Recorder *flight = recorder.load(std::memory_order_acquire);
+
+      if(!logged && !flight)
+      {
+        return;
+      }
+
+      if(!admit(priority, format, constant))
+      {
+        errno = error;
+        return;
+      }
+
+      if(flight)
+      {
+        va_list args2;
+        va_copy(args2, arguments);
+        errno = error;
+        flight->vwrite(priority, ident ? ident->c_str() : nullptr, format, args2);
+        va_end(args2);
+
+        if(!logged)
+        {
+          errno = error;
+          return;
+        }
+      }
+
+      errno = error;
+
+      if(asynchronous.load(std::memory_order_relaxed) && enqueue(ident, priority, format, arguments, constant,
+                                                                   priority <= limit, priority <= print))
+      {
+        errno = error;
+        return;
+      }
 
-      if(priority <= _printLevel)
+      if(priority <= limit)
       {
-        va_start(arguments, format);
-        consoleOutput(priority, format, arguments);
-        va_end(arguments);
+        va_list args2;
+        va_copy(args2, arguments);
+        errno = error;
+        Sink::get().vwrite(LOG_MAKEPRI(_facility, priority), ident ? ident->c_str() : nullptr, _options, format, args2);
+        va_end(args2);
       }
+
+      if(priority <= print)
+      {
+        struct timeval elapsed;
+        bool stamped = stamp(elapsed);
+        errno = error;
+        consoleOutput(priority, stamped ? &elapsed : nullptr, format, arguments);
+      }
+
+      errno = error;
     }
 
-    void Logger::vprint(const Overkiz::Log::Priority priority, const char * format,
-                        va_list arguments)
+    bool Logger::enqueue(const std::string * ident, const Overkiz::Log::Priority priority, const char * format,
+                         va_list arguments, bool constant, bool logged, bool console)
     {
-      if(!_temporaryIdent.empty())
+      Drain *drain = Drain::get();
+
+      if(!drain)
+      {
+        return false;
+      }
+
+      if(!ring)
+      {
+        ring = new Ring(capacity);
+        drain->attach(ring);
+      }
+
+      Record *record = ring->reserve();
+
+      while(!record)
+      {
+        if(overflow == OVK_OVERFLOW_DROP)
+        {
+          //The drain reports the count once it has emptied the ring
+          if(ring->dropped++ == 0)
+          {
+            drain->wake();
+          }
+
+          return true;
+        }
+
+        drain->wake();
+        usleep(1000);
+        record = ring->reserve();
+      }
+
+      record->priority = priority;
+      record->facility = _facility;
+      record->options = _options;
+      record->logged = logged;
+      record->console = console;
+      record->timed = record->console && stamp(record->elapsed);
+      record->ident[0] = '\0';
+
+      if(ident)
       {
-        defaultIdent();
+        strncat(record->ident, ident->c_str(), sizeof(record->ident) - 1);
       }
 
-      va_list args2;
-      va_copy(args2, arguments);
-      vsyslog(LOG_MAKEPRI(_facility, priority), format, args2);
-      va_end(args2);
+      if(!constant || !binary.load(std::memory_order_relaxed) || !record->encode(format, arguments))
+      {
+        va_list args2;
+        va_copy(args2, arguments);
+        vsnprintf(record->text, sizeof(record->text), format, args2);
+        va_end(args2);
+        record->format = nullptr;
+      }
 
-      if(priority <= _printLevel)
+      if(ring->commit())
       {
-        consoleOutput(priority, format, arguments);
+        drain->wake();
       }
+
+      return true;
     }
 
-    void Logger::print(const std::string & ident, const Overkiz::Log::Priority priority,  const char * format, ...)
+    void Logger::setAsynchronous(bool enabled, Overkiz::Log::Overflow policy, size_t size)
     {
-      if(_temporaryIdent != ident)
+      if(enabled)
       {
-        updateIdent(ident);
+        overflow = policy;
+        capacity = size ? size : 1;
+        asynchronous = true;
       }
+      else
+      {
+        asynchronous = false;
+        flush();
+      }
+    }
 
-      va_list arguments;
-      va_start(arguments, format);
-      vsyslog(LOG_MAKEPRI(_facility, priority), format, arguments);
-      va_end(arguments);
+    bool Logger::isAsynchronous()
+    {
+      return asynchronous;
+    }
 
-      if(priority <= _printLevel)
+    void Logger::setBinary(bool enabled)
+    {
+      binary = enabled;
+    }
+
+    bool Logger::isBinary()
+    {
+      return binary;
+    }
+
+    void Logger::flush()
+    {
+      //Nothing is queued before the drain is started
+      Drain *drain = Drain::current();
+
+      if(drain)
       {
-        va_start(arguments, format);
-        consoleOutput(priority, format, arguments);
-        va_end(arguments);
+        drain->flush();
       }
     }
 
@@ -187,6 +403,7 @@ namespace Overkiz
     void Logger::setPrintLevel(const Overkiz::Log::Priority priority)
     {
       _printLevel = priority;
+      raise(priority);
     }
 
     Overkiz::Log::Priority Logger::getPrintLevel() const
@@ -194,22 +411,176 @@ namespace Overkiz
       return _printLevel;
     }
 
-    void Logger::consoleOutput(const Overkiz::Log::Priority priority, const char * format,
-                               va_list arguments)
+    void Logger::setLevel(const Overkiz::Log::Priority priority)
+    {
+      level = priority;
+      raise(OVK_UNKNOWN_PRIORITY);
+    }
+
+    Overkiz::Log::Priority Logger::getLevel()
+    {
+      return (Overkiz::Log::Priority) level.load();
+    }
+
+    void Logger::raise(const Overkiz::Log::Priority printLevel)
+    {
+      int current = printed;
+
+      //A thread may still print this level, the threshold never decreases below it
+      while(printLevel > current && !printed.compare_exchange_weak(current, printLevel))
+      {
+      }
+
+      threshold = std::max(level.load(), recorder ? (int) OVK_DEBUG : printed.load());
+    }
+
+    void Logger::setRateLimit(unsigned messages, unsigned row)
+    {
+      burst = row ? row : messages;
+      rate = messages;
+    }
+
+    void Logger::setFolding(bool enabled, unsigned seconds)
+    {
+      delay = seconds;
+      folding = enabled;
+    }
+
+    bool Logger::admit(const Overkiz::Log::Priority priority, const char * format, bool constant)
     {
-      if(timed != OVK_TIME_UNKNOWN)
+      unsigned limit = rate.load(std::memory_order_relaxed);
+      Site site(constant ? format : nullptr, priority);
+
+      uint64_t time = 0;
+
+      if(repeats)
       {
-        struct timeval tv2, res;
-        gettimeofday(&tv2, NULL);
-        timersub(&tv2, &tv1, &res);
+        time = coarse();
+
+        if(site != last || time - folded >= delay.load(std::memory_order_relaxed) * 1000000000ULL)
+        {
+          report();
+        }
+      }
+
+      //Other formats may be built at runtime, they don't identify a call site
+      if(!constant)
+      {
+        last = site;
+        return true;
+      }
 
-        if(timed == OVK_TIME_BETWEEN_MESSAGE)
+      if(folding.load(std::memory_order_relaxed))
+      {
+        if(site == last)
         {
-          gettimeofday(&tv1, NULL);
+          if(!repeats++)
+          {
+            folded = time ? time : coarse();
+          }
+
+          return false;
         }
 
+        last = site;
+      }
+
+      if(!limit)
+      {
+        return true;
+      }
+
+      if(!time)
+      {
+        time = coarse();
+      }
+
+      unsigned capacity = burst.load(std::memory_order_relaxed);
+      auto it = buckets.find(site);
+
+      if(it == buckets.end())
+      {
+        Bucket bucket = {(double) capacity, time, 0};
+        it = buckets.insert(std::make_pair(site, bucket)).first;
+      }
+
+      Bucket& bucket = it->second;
+      bucket.tokens = std::min((double) capacity, bucket.tokens + (time - bucket.last) * limit / 1e9);
+      bucket.last = time;
+
+      if(bucket.tokens < 1)
+      {
+        bucket.suppressed++;
+        return false;
+      }
+
+      bucket.tokens--;
+
+      if(bucket.suppressed)
+      {
+        unsigned count = bucket.suppressed;
+        bucket.suppressed = 0;
+        notify(priority, "Suppressed %u messages: %s", count, format);
+        last = site;
+      }
+
+      return true;
+    }
+
+    void Logger::setRecorder(Overkiz::Log::Recorder * flight)
+    {
+      recorder = flight;
+      raise(OVK_UNKNOWN_PRIORITY);
+    }
+
+    Overkiz::Log::Recorder * Logger::getRecorder()
+    {
+      return recorder;
+    }
+
+    void Logger::report()
+    {
+      unsigned count = repeats;
+      repeats = 0;
+      notify((Overkiz::Log::Priority) last.second, "Last message repeated %u times.", count);
+    }
+
+    void Logger::notify(const Overkiz::Log::Priority priority, const char * format, ...)
+    {
+      va_list arguments;
+      va_start(arguments, format);
+      log(nullptr, priority, format, arguments);
+      va_end(arguments);
+    }
+
+    bool Logger::stamp(struct timeval & elapsed)
+    {
+      if(timed == OVK_TIME_UNKNOWN)
+      {
+        return false;
+      }
+
+      struct timeval tv2;
+      gettimeofday(&tv2, NULL);
+      timersub(&tv2, &tv1, &elapsed);
+
+      if(timed == OVK_TIME_BETWEEN_MESSAGE)
+      {
+        tv1 = tv2;
+      }
+
+      return true;
+    }
+
+    void Logger::consoleOutput(const Overkiz::Log::Priority priority, const struct timeval * elapsed,
+                               const char * format, va_list arguments)
+    {
+      int error = errno;
+
+      if(elapsed)
+      {
         FILE * fs = priority < OVK_NOTICE ? stderr : stdout;
-        fprintf(fs,"%08lu.%03lu ", res.tv_sec*1000 + res.tv_usec/1000 , res.tv_usec%1000);
+        fprintf(fs,"%08lu.%03lu ", elapsed->tv_sec*1000 + elapsed->tv_usec/1000 , elapsed->tv_usec%1000);
       }
 
       switch(priority)
@@ -219,29 +590,34 @@ namespace Overkiz
         case OVK_CRITICAL:
         case OVK_ERROR:
           fprintf(stderr, LOG_FORMAT_BOLD LOG_FORMAT_RED);
+          errno = error;
           vfprintf(stderr, format, arguments);
           fprintf(stderr, LOG_FORMAT_RESET_ALL"\n");
           break;
 
         case OVK_WARNING:
           fprintf(stderr, LOG_FORMAT_YELLOW);
+          errno = error;
           vfprintf(stderr, format, arguments);
           fprintf(stderr, LOG_FORMAT_RESET_ALL"\n");
           break;
 
         case OVK_NOTICE:
           fprintf(stdout, LOG_FORMAT_GREEN);
+          errno = error;
           vfprintf(stdout, format, arguments);
           fprintf(stdout, LOG_FORMAT_RESET_ALL"\n");
           break;
 
         case OVK_INFO:
+          errno = error;
           vfprintf(stdout, format, arguments);
           fprintf(stdout, "\n");
           break;
 
         case OVK_DEBUG:
           fprintf(stdout, LOG_FORMAT_BLUE);
+          errno = error;
           vfprintf(stdout, format, arguments);
           fprintf(stdout, LOG_FORMAT_RESET_ALL"\n");
           break;
@@ -253,6 +629,30 @@ namespace Overkiz
 
     Thread::Key<Logger> Logger::logger;
 
+    std::atomic<bool> Logger::asynchronous(false);
+
+    std::atomic<bool> Logger::binary(false);
+
+    std::atomic<Overkiz::Log::Overflow> Logger::overflow(OVK_OVERFLOW_DROP);
+
+    std::atomic<size_t> Logger::capacity(256);
+
+    std::atomic<int> Logger::level(OVK_DEBUG);
+
+    std::atomic<int> Logger::printed(OVK_ERROR);
+
+    std::atomic<int> Logger::threshold(OVK_DEBUG);
+
+    std::atomic<Overkiz::Log::Recorder *> Logger::recorder(nullptr);
+
+    std::atomic<unsigned> Logger::rate(0);
+
+    std::atomic<unsigned> Logger::burst(0);
+
+    std::atomic<bool> Logger::folding(false);
+
+    std::atomic<unsigned> Logger::delay(30);
+
   }
 
 }
@@ -0,0 +1,332 @@
+/*
+ * LogCategory.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "LogCategory.h"
+
+#define LOG_ENVNAME_CATEGORIES        "OVK_LOG_CATEGORIES"
+
+#define LOG_CATEGORY_SEPARATORS       ", ;\t\r\n"
+
+namespace Overkiz
+{
+
+  namespace Log
+  {
+
+    namespace
+    {
+
+      typedef std::vector<std::pair<std::string, int>> Settings;
+
+      bool parse(const std::string& text, Settings& settings)
+      {
+        bool valid = true;
+        size_t start = text.find_first_not_of(LOG_CATEGORY_SEPARATORS);
+
+        while(start != std::string::npos)
+        {
+          size_t end = text.find_first_of(LOG_CATEGORY_SEPARATORS, start);
+          std::string setting = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+          size_t equal = setting.find('=');
+          start = text.find_first_not_of(LOG_CATEGORY_SEPARATORS, end);
+
+          if(equal == 0 || equal == std::string::npos)
+          {
+            valid = false;
+            continue;
+          }
+
+          std::string value = setting.substr(equal + 1);
+          Overkiz::Log::Priority priority = OVK_UNKNOWN_PRIORITY;
+
+          if(!value.empty() && value != "default")
+          {
+            priority = Logger::getPriority(value);
+
+            if(priority == OVK_UNKNOWN_PRIORITY)
+            {
+              valid = false;
+              continue;
+            }
+          }
+
+          settings.push_back(std::make_pair(setting.substr(0, equal), (int) priority));
+        }
+
+        return valid;
+      }
+
+      /**
+       * Categories of the process and the levels set by name.
+       */
+      struct Registry
+      {
+        Registry()
+        {
+          const char * env = getenv(LOG_ENVNAME_CATEGORIES);
+
+          if(env != NULL)
+          {
+            Settings settings;
+            parse(env, settings);
+
+            for(auto& setting : settings)
+            {
+              levels[setting.first] = setting.second;
+            }
+          }
+        }
+
+        Thread::Lock lock;
+        std::multimap<std::string, Category *> categories;
+        std::map<std::string, int> levels;
+      };
+
+      Registry& registry()
+      {
+        static Registry instance;
+        return instance;
+      }
+
+    }
+
+    Category::Category(const std::string& categoryName) :
+      name(categoryName), level(OVK_UNKNOWN_PRIORITY)
+    {
+      Registry& known = registry();
+      known.lock.acquire();
+      auto it = known.levels.find(name);
+
+      if(it != known.levels.end())
+      {
+        level = it->second;
+      }
+
+      known.categories.insert(std::make_pair(name, this));
+      known.lock.release();
+    }
+
+    Category::~Category()
+    {
+      Registry& known = registry();
+      known.lock.acquire();
+      auto range = known.categories.equal_range(name);
+
+      for(auto it = range.first; it != range.second; it++)
+      {
+        if(it->second == this)
+        {
+          known.categories.erase(it);
+          break;
+        }
+      }
+
+      known.lock.release();
+    }
+
+    const std::string& Category::getName() const
+    {
+      return name;
+    }
+
+    Overkiz::Log::Priority Category::getLevel() const
+    {
+      return (Overkiz::Log::Priority) level.load();
+    }
+
+    void Category::print(const Overkiz::Log::Priority priority, const char * format, ...)
+    {
+      va_list arguments;
+      va_start(arguments, format);
+      Logger::get()->log(nullptr, priority, format, arguments, false, level.load(std::memory_order_relaxed));
+      va_end(arguments);
+    }
+
+    void Category::record(const Overkiz::Log::Priority priority, const char * format, ...)
+    {
+      va_list arguments;
+      va_start(arguments, format);
+      Logger::get()->log(nullptr, priority, format, arguments, true, level.load(std::memory_order_relaxed));
+      va_end(arguments);
+    }
+
+    void Category::setLevel(const std::string& name, const Overkiz::Log::Priority priority)
+    {
+      Registry& known = registry();
+      known.lock.acquire();
+
+      if(priority == OVK_UNKNOWN_PRIORITY)
+      {
+        known.levels.erase(name);
+      }
+      else
+      {
+        known.levels[name] = priority;
+      }
+
+      auto range = known.categories.equal_range(name);
+
+      for(auto it = range.first; it != range.second; it++)
+      {
+        it->second->level = priority;
+      }
+
+      known.lock.release();
+    }
+
+    bool Category::configure(const std::string& text)
+    {
+      Settings settings;
+      bool valid = parse(text, settings);
+
+      for(auto& setting : settings)
+      {
+        setLevel(setting.first, (Overkiz::Log::Priority) setting.second);
+        OVK_NOTICE("Log category %s set to %s", setting.first.c_str(),
+                   setting.second == OVK_UNKNOWN_PRIORITY ? "default" : PRIORITY_STRING_LC[setting.second].c_str());
+      }
+
+      return valid;
+    }
+
+    Control::Reader::Reader(Control *owner) :
+      control(owner)
+    {
+    }
+
+    Control::Reader::~Reader()
+    {
+    }
+
+    void Control::Reader::notified(Overkiz::Subject<Overkiz::Pipe::Listener> * subject, const uint32_t event)
+    {
+      if(event & Overkiz::Pipe::INPUT_READY)
+      {
+        char buffer[256];
+        int size = control->fifo.receive(buffer, sizeof(buffer));
+
+        if(size > 0)
+        {
+          control->pending.append(buffer, size);
+          control->apply(false);
+        }
+      }
+
+      //The last writer closed the fifo, wait for the next one
+      if(event & (Overkiz::Pipe::DISCONNECTED | Overkiz::Pipe::ERROR))
+      {
+        control->apply(true);
+        control->fifo.close();
+        control->fifo.open(control->fifoPath);
+      }
+    }
+
+    Control::Control() :
+      reader(Shared::Pointer<Reader>::create(this)), signal(0)
+    {
+      fifo.add(reader);
+    }
+
+    Control::~Control()
+    {
+      if(signal)
+      {
+        Signal::Manager::remove(signal, this);
+      }
+
+      if(!fifoPath.empty())
+      {
+        fifo.close();
+      }
+
+      fifo.remove(reader);
+    }
+
+    void Control::listen(const std::string& path)
+    {
+      if(!fifoPath.empty())
+      {
+        fifo.close();
+        pending.clear();
+      }
+
+      fifoPath = path;
+      fifo.open(path);
+    }
+
+    void Control::reload(const std::string& path, uint32_t reloadSignal)
+    {
+      if(signal)
+      {
+        Signal::Manager::remove(signal, this);
+      }
+
+      filePath = path;
+      signal = reloadSignal;
+      Signal::Manager::add(signal, this);
+      load();
+    }
+
+    void Control::handle(const Overkiz::Signal& received)
+    {
+      load();
+    }
+
+    void Control::apply(bool end)
+    {
+      size_t line = end ? pending.size() : pending.rfind('\n');
+
+      if(line == std::string::npos)
+      {
+        return;
+      }
+
+      std::string settings = pending.substr(0, line);
+      pending.erase(0, line);
+
+      if(!Category::configure(settings))
+      {
+        OVK_WARNING("Invalid log category settings: %s", settings.c_str());
+      }
+    }
+
+    void Control::load()
+    {
+      int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+
+      if(fd == -1)
+      {
+        OVK_WARNING("Can't read log category settings %s: %s", filePath.c_str(), strerror(errno));
+        return;
+      }
+
+      std::string text;
+      char buffer[256];
+      ssize_t size;
+
+      while((size = read(fd, buffer, sizeof(buffer))) > 0)
+      {
+        text.append(buffer, size);
+      }
+
+      close(fd);
+
+      if(!Category::configure(text))
+      {
+        OVK_WARNING("Invalid log category settings in %s", filePath.c_str());
+      }
+    }
+
+  }
+
+}
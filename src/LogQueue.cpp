@@ -0,0 +1,761 @@
+/*
+ * LogQueue.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <cstddef>
+
+#include "LogQueue.h"
+#include "LogSink.h"
+
+#define MAX_CONVERSION_SIZE 32
+
+namespace Overkiz
+{
+
+  namespace Log
+  {
+
+    namespace
+    {
+
+      enum Type
+      {
+        PERCENT,
+        INT,
+        LONG,
+        LONG_LONG,
+        SIZE,
+        INTMAX,
+        PTRDIFF,
+        DOUBLE,
+        LONG_DOUBLE,
+        STRING,
+        POINTER,
+        ERROR,
+        UNSUPPORTED,
+      };
+
+      struct Conversion
+      {
+        const char *start;
+        size_t length;
+
+        /**
+         * Number of '*' widths and precisions, passed as int arguments.
+         */
+        int stars;
+
+        /**
+         * Literal precision, -1 if none, -2 if passed as the last star.
+         */
+        int precision;
+        Type type;
+      };
+
+      /**
+       * Parse a printf conversion.
+       *
+       * @param cursor : the '%' of the conversion, moved after it.
+       * @return the conversion.
+       */
+      Conversion parse(const char *& cursor)
+      {
+        Conversion conversion;
+        conversion.start = cursor++;
+        conversion.stars = 0;
+        conversion.precision = -1;
+        conversion.type = UNSUPPORTED;
+
+        while(*cursor && strchr("#0- +'I", *cursor))
+        {
+          cursor++;
+        }
+
+        if(*cursor == '*')
+        {
+          conversion.stars++;
+          cursor++;
+        }
+
+        while(isdigit(*cursor))
+        {
+          cursor++;
+        }
+
+        if(*cursor == '.')
+        {
+          cursor++;
+          conversion.precision = 0;
+
+          if(*cursor == '*')
+          {
+            conversion.stars++;
+            conversion.precision = -2;
+            cursor++;
+          }
+
+          while(isdigit(*cursor))
+          {
+            conversion.precision = std::min(conversion.precision * 10 + (*cursor - '0'), LOG_MAX_MESSAGE_SIZE);
+            cursor++;
+          }
+        }
+
+        //Integer conversions without modifier, hh and h are promoted to int
+        Type integer = INT;
+        bool modified = false;
+
+        if(*cursor == 'h')
+        {
+          cursor += cursor[1] == 'h' ? 2 : 1;
+        }
+        else if(*cursor == 'l' && cursor[1] == 'l')
+        {
+          integer = LONG_LONG;
+          cursor += 2;
+        }
+        else if(*cursor && strchr("lqzjtL", *cursor))
+        {
+          modified = true;
+
+          switch(*cursor)
+          {
+            case 'l':
+              integer = LONG;
+              break;
+
+            case 'q':
+              integer = LONG_LONG;
+              break;
+
+            case 'z':
+              integer = SIZE;
+              break;
+
+            case 'j':
+              integer = INTMAX;
+              break;
+
+            case 't':
+              integer = PTRDIFF;
+              break;
+
+            default:
+              integer = UNSUPPORTED;
+              break;
+          }
+
+          cursor++;
+        }
+
+        switch(*cursor)
+        {
+          case '%':
+            conversion.type = cursor == conversion.start + 1 ? PERCENT : UNSUPPORTED;
+            break;
+
+          case 'd':
+          case 'i':
+          case 'o':
+          case 'u':
+          case 'x':
+          case 'X':
+            conversion.type = integer;
+            break;
+
+          case 'c':
+            conversion.type = modified ? UNSUPPORTED : INT;
+            break;
+
+          case 'e':
+          case 'E':
+          case 'f':
+          case 'F':
+          case 'g':
+          case 'G':
+          case 'a':
+          case 'A':
+            conversion.type = !modified || cursor[-1] == 'l' ? DOUBLE : cursor[-1] == 'L' ? LONG_DOUBLE : UNSUPPORTED;
+            break;
+
+          case 's':
+            conversion.type = modified ? UNSUPPORTED : STRING;
+            break;
+
+          case 'p':
+            conversion.type = POINTER;
+            break;
+
+          case 'm':
+            conversion.type = ERROR;
+            break;
+
+          default:
+            //%n, wide and positional conversions
+            break;
+        }
+
+        if(*cursor)
+        {
+          cursor++;
+        }
+
+        conversion.length = cursor - conversion.start;
+
+        if(conversion.length >= MAX_CONVERSION_SIZE)
+        {
+          conversion.type = UNSUPPORTED;
+        }
+
+        return conversion;
+      }
+
+      template<typename T>
+      bool store(char *buffer, size_t& used, T value)
+      {
+        if(used + sizeof(T) > LOG_MAX_MESSAGE_SIZE)
+        {
+          return false;
+        }
+
+        memcpy(buffer + used, &value, sizeof(T));
+        used += sizeof(T);
+        return true;
+      }
+
+      template<typename T>
+      T load(const char *buffer, size_t& read)
+      {
+        T value;
+        memcpy(&value, buffer + read, sizeof(T));
+        read += sizeof(T);
+        return value;
+      }
+
+      template<typename T>
+      void emit(char *buffer, size_t size, size_t& written, const char *conversion, const int *stars,
+                int count, T value)
+      {
+        int ret;
+
+        switch(count)
+        {
+          case 0:
+            ret = snprintf(buffer + written, size - written, conversion, value);
+            break;
+
+          case 1:
+            ret = snprintf(buffer + written, size - written, conversion, stars[0], value);
+            break;
+
+          default:
+            ret = snprintf(buffer + written, size - written, conversion, stars[0], stars[1], value);
+            break;
+        }
+
+        if(ret > 0)
+        {
+          written = std::min(written + ret, size - 1);
+        }
+      }
+
+    }
+
+    bool Record::encode(const char *literal, va_list arguments)
+    {
+      int error = errno;
+      size_t used = 0;
+      bool encoded = true;
+      va_list args;
+      va_copy(args, arguments);
+
+      for(const char *cursor = literal; *cursor && encoded; )
+      {
+        if(*cursor != '%')
+        {
+          cursor++;
+          continue;
+        }
+
+        Conversion conversion = parse(cursor);
+        int star = -1;
+
+        for(int i = 0; i < conversion.stars && encoded; i++)
+        {
+          star = va_arg(args, int);
+          encoded = store(text, used, star);
+        }
+
+        //A negative precision passed as argument is ignored
+        int precision = conversion.precision == -2 ? std::max(star, -1) : conversion.precision;
+
+        switch(conversion.type)
+        {
+          case PERCENT:
+            break;
+
+          case INT:
+            encoded = encoded && store(text, used, va_arg(args, int));
+            break;
+
+          case LONG:
+            encoded = encoded && store(text, used, va_arg(args, long));
+            break;
+
+          case LONG_LONG:
+            encoded = encoded && store(text, used, va_arg(args, long long));
+            break;
+
+          case SIZE:
+            encoded = encoded && store(text, used, va_arg(args, size_t));
+            break;
+
+          case INTMAX:
+            encoded = encoded && store(text, used, va_arg(args, intmax_t));
+            break;
+
+          case PTRDIFF:
+            encoded = encoded && store(text, used, va_arg(args, std::ptrdiff_t));
+            break;
+
+          case DOUBLE:
+            encoded = encoded && store(text, used, va_arg(args, double));
+            break;
+
+          case LONG_DOUBLE:
+            encoded = encoded && store(text, used, va_arg(args, long double));
+            break;
+
+          case POINTER:
+            encoded = encoded && store(text, used, va_arg(args, void *));
+            break;
+
+          case ERROR:
+            encoded = encoded && store(text, used, error);
+            break;
+
+          case STRING:
+          {
+            const char *string = va_arg(args, const char *);
+
+            if(!string)
+            {
+              string = "(null)";
+            }
+
+            encoded = encoded && used < LOG_MAX_MESSAGE_SIZE;
+
+            if(encoded)
+            {
+              //Long strings are truncated to the free space, a string with a precision may not be terminated
+              size_t length = LOG_MAX_MESSAGE_SIZE - used - 1;
+              length = strnlen(string, precision < 0 ? length : std::min(length, (size_t) precision));
+              memcpy(text + used, string, length);
+              text[used + length] = '\0';
+              used += length + 1;
+            }
+
+            break;
+          }
+
+          default:
+            encoded = false;
+            break;
+        }
+      }
+
+      va_end(args);
+      format = encoded ? literal : nullptr;
+      return encoded;
+    }
+
+    const char *Record::decode(char *buffer, size_t size) const
+    {
+      if(!format)
+      {
+        return text;
+      }
+
+      size_t written = 0;
+      size_t read = 0;
+
+      for(const char *cursor = format; *cursor && written + 1 < size; )
+      {
+        if(*cursor != '%')
+        {
+          buffer[written++] = *cursor++;
+          continue;
+        }
+
+        Conversion conversion = parse(cursor);
+        char spec[MAX_CONVERSION_SIZE];
+        int stars[2] = {0, 0};
+        memcpy(spec, conversion.start, conversion.length);
+        spec[conversion.length] = '\0';
+
+        for(int i = 0; i < conversion.stars; i++)
+        {
+          stars[i] = load<int>(text, read);
+        }
+
+        switch(conversion.type)
+        {
+          case PERCENT:
+            buffer[written++] = '%';
+            break;
+
+          case INT:
+            emit(buffer, size, written, spec, stars, conversion.stars, load<int>(text, read));
+            break;
+
+          case LONG:
+            emit(buffer, size, written, spec, stars, conversion.stars, load<long>(text, read));
+            break;
+
+          case LONG_LONG:
+            emit(buffer, size, written, spec, stars, conversion.stars, load<long long>(text, read));
+            break;
+
+          case SIZE:
+            emit(buffer, size, written, spec, stars, conversion.stars, load<size_t>(text, read));
+            break;
+
+          case INTMAX:
+            emit(buffer, size, written, spec, stars, conversion.stars, load<intmax_t>(text, read));
+            break;
+
+          case PTRDIFF:
+            emit(buffer, size, written, spec, stars, conversion.stars, load<std::ptrdiff_t>(text, read));
+            break;
+
+          case DOUBLE:
+            emit(buffer, size, written, spec, stars, conversion.stars, load<double>(text, read));
+            break;
+
+          case LONG_DOUBLE:
+            emit(buffer, size, written, spec, stars, conversion.stars, load<long double>(text, read));
+            break;
+
+          case POINTER:
+            emit(buffer, size, written, spec, stars, conversion.stars, load<void *>(text, read));
+            break;
+
+          case ERROR:
+          {
+            char message[64];
+            spec[conversion.length - 1] = 's';
+            emit(buffer, size, written, spec, stars, conversion.stars,
+                 strerror_r(load<int>(text, read), message, sizeof(message)));
+            break;
+          }
+
+          case STRING:
+          {
+            const char *string = text + read;
+            read += strlen(string) + 1;
+            emit(buffer, size, written, spec, stars, conversion.stars, string);
+            break;
+          }
+
+          default:
+            break;
+        }
+      }
+
+      buffer[written] = '\0';
+      return buffer;
+    }
+
+    Ring::Ring(size_t capacity) :
+      dropped(0), closed(false), mask(1), head(0), tail(0), next(nullptr)
+    {
+      while(mask < capacity)
+      {
+        mask <<= 1;
+      }
+
+      records = new Record[mask];
+      mask--;
+    }
+
+    Ring::~Ring()
+    {
+      delete[] records;
+    }
+
+    Record *Ring::reserve()
+    {
+      size_t current = head.load(std::memory_order_relaxed);
+
+      if(current - tail.load(std::memory_order_acquire) > mask)
+      {
+        return nullptr;
+      }
+
+      return &records[current & mask];
+    }
+
+    bool Ring::commit()
+    {
+      size_t current = head.load(std::memory_order_relaxed);
+      head.store(current + 1);
+      //Read after the record is published: either the consumer sees it or it had emptied the ring
+      return tail.load() == current;
+    }
+
+    Record *Ring::front()
+    {
+      size_t current = tail.load(std::memory_order_relaxed);
+
+      if(head.load() == current)
+      {
+        return nullptr;
+      }
+
+      return &records[current & mask];
+    }
+
+    void Ring::pop()
+    {
+      tail.store(tail.load(std::memory_order_relaxed) + 1);
+    }
+
+    bool Ring::empty() const
+    {
+      return head.load() == tail.load();
+    }
+
+    std::atomic<Drain *> Drain::instance(nullptr);
+
+    Drain *Drain::get()
+    {
+      static Drain drain;
+      return instance.load(std::memory_order_acquire);
+    }
+
+    Drain *Drain::current()
+    {
+      return instance.load(std::memory_order_acquire);
+    }
+
+    Drain::Drain() :
+      rings(nullptr), stopping(false)
+    {
+      fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+      if(fd == -1)
+      {
+        return;
+      }
+
+      if(pthread_create(&thread, nullptr, &Drain::run, this) != 0)
+      {
+        close(fd);
+        fd = -1;
+        return;
+      }
+
+      instance.store(this, std::memory_order_release);
+    }
+
+    Drain::~Drain()
+    {
+      if(fd == -1)
+      {
+        return;
+      }
+
+      //Loggers logging from now on write synchronously
+      instance = nullptr;
+      stopping = true;
+      wake();
+      pthread_join(thread, nullptr);
+      close(fd);
+
+      //Rings of living loggers are leaked, their threads may still close them
+      lock.acquire();
+
+      for(Ring *ring = rings; ring; )
+      {
+        Ring *next = ring->next;
+
+        if(ring->closed)
+        {
+          delete ring;
+        }
+
+        ring = next;
+      }
+
+      rings = nullptr;
+      lock.release();
+    }
+
+    void Drain::attach(Ring *ring)
+    {
+      lock.acquire();
+      ring->next = rings;
+      rings = ring;
+      lock.release();
+    }
+
+    void Drain::wake()
+    {
+      uint64_t value = 1;
+
+      if(::write(fd, &value, sizeof(value)) < 0)
+      {
+        //The counter is already set, the thread will wake up
+      }
+    }
+
+    void Drain::flush()
+    {
+      bool empty = false;
+
+      while(!empty)
+      {
+        empty = true;
+        lock.acquire();
+
+        for(Ring *ring = rings; ring && empty; ring = ring->next)
+        {
+          empty = ring->empty();
+        }
+
+        lock.release();
+
+        if(!empty)
+        {
+          wake();
+          usleep(1000);
+        }
+      }
+    }
+
+    bool Drain::drain()
+    {
+      bool written = false;
+      lock.acquire();
+
+      for(Ring **link = &rings; *link; )
+      {
+        Ring *ring = *link;
+
+        //Read before the records, the logger closes its ring after its last record
+        bool closed = ring->closed;
+
+        for(Record *record = ring->front(); record; record = ring->front())
+        {
+          write(*record);
+          ring->pop();
+          written = true;
+        }
+
+        size_t dropped = ring->dropped.exchange(0);
+
+        if(dropped)
+        {
+          char message[64];
+          snprintf(message, sizeof(message), "%zu log messages dropped.", dropped);
+
+          if(batch.full())
+          {
+            Sink::get().write(batch);
+          }
+
+          batch.add(LOG_MAKEPRI(LOG_DAEMON, LOG_WARNING), nullptr, 0, message);
+        }
+
+        if(closed && ring->empty())
+        {
+          *link = ring->next;
+          delete ring;
+        }
+        else
+        {
+          link = &ring->next;
+        }
+      }
+
+      //Sent before flush() sees the rings empty
+      Sink::get().write(batch);
+      lock.release();
+      return written;
+    }
+
+    void Drain::write(const Record& record)
+    {
+      char buffer[LOG_MAX_MESSAGE_SIZE];
+      const char *text = record.decode(buffer, sizeof(buffer));
+
+      if(record.logged)
+      {
+        if(batch.full())
+        {
+          Sink::get().write(batch);
+        }
+
+        batch.add(LOG_MAKEPRI(record.facility, record.priority), record.ident, record.options, text);
+      }
+
+      if(record.console)
+      {
+        console(record.priority, record.timed ? &record.elapsed : nullptr, "%s", text);
+      }
+    }
+
+    void Drain::console(const Overkiz::Log::Priority priority, const struct timeval *elapsed,
+                        const char *format, ...)
+    {
+      va_list arguments;
+      va_start(arguments, format);
+      Logger::consoleOutput(priority, elapsed, format, arguments);
+      va_end(arguments);
+    }
+
+    void Drain::run()
+    {
+      struct pollfd event;
+      event.fd = fd;
+      event.events = POLLIN;
+
+      while(!stopping)
+      {
+        if(drain())
+        {
+          continue;
+        }
+
+        if(poll(&event, 1, -1) > 0)
+        {
+          uint64_t value;
+
+          if(read(fd, &value, sizeof(value)) < 0)
+          {
+            //Already reset by a previous wake up
+          }
+        }
+      }
+
+      drain();
+    }
+
+    void *Drain::run(void *drain)
+    {
+      static_cast<Drain *>(drain)->run();
+      return nullptr;
+    }
+
+  }
+
+}
@@ -0,0 +1,345 @@
+/*
+ * LogRecorder.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include <kizbox/framework/core/Errno.h>
+#include "LogRecorder.h"
+
+#define RECORDER_VERSION 1
+#define RECORDER_KEY 0x4f564b21
+
+#define ALT_STACK_SIZE (64 * 1024)
+
+namespace Overkiz
+{
+
+  namespace Log
+  {
+
+    namespace
+    {
+
+      //Async signal safe formatting of the dumped lines
+
+      void append(char *line, size_t& used, size_t size, const char *string, size_t length)
+      {
+        length = std::min(length, size - used);
+        memcpy(line + used, string, length);
+        used += length;
+      }
+
+      void append(char *line, size_t& used, size_t size, uint64_t value, int width)
+      {
+        char digits[24];
+        int count = 0;
+
+        do
+        {
+          digits[sizeof(digits) - ++count] = '0' + value % 10;
+          value /= 10;
+        }
+        while(value || count < width);
+
+        append(line, used, size, digits + sizeof(digits) - count, count);
+      }
+
+      void output(int fd, const char *buffer, size_t size)
+      {
+        while(size > 0)
+        {
+          ssize_t ret = ::write(fd, buffer, size);
+
+          if(ret <= 0)
+          {
+            if(ret < 0 && errno == EINTR)
+            {
+              continue;
+            }
+
+            return;
+          }
+
+          buffer += ret;
+          size -= ret;
+        }
+      }
+
+    }
+
+    std::atomic<Recorder *> Recorder::fatal(nullptr);
+
+    Recorder::Recorder(const std::string& path, size_t fileSize)
+    {
+      size = std::max(fileSize, sizeof(Header) + 4096);
+      int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+      if(fd == -1)
+      {
+        throw Overkiz::Errno::Exception();
+      }
+
+      struct stat st;
+
+      if(fstat(fd, &st) != 0 || ((size_t) st.st_size != size && ftruncate(fd, size) != 0))
+      {
+        int error = errno;
+        close(fd);
+        throw Overkiz::Errno::Exception(error);
+      }
+
+      void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      int error = errno;
+      close(fd);
+
+      if(mapping == MAP_FAILED)
+      {
+        throw Overkiz::Errno::Exception(error);
+      }
+
+      header = static_cast<Header *>(mapping);
+      data = reinterpret_cast<char *>(header + 1);
+      uint64_t capacity = (size - sizeof(Header)) & ~7ULL;
+
+      //Keep the messages of a previous recorder of the same ring
+      if(memcmp(header->magic, LOG_RECORDER_MAGIC, sizeof(header->magic)) != 0
+         || header->version != RECORDER_VERSION || header->capacity != capacity)
+      {
+        memcpy(header->magic, LOG_RECORDER_MAGIC, sizeof(header->magic));
+        header->version = RECORDER_VERSION;
+        header->reserved = 0;
+        header->capacity = capacity;
+        header->head.store(0);
+      }
+    }
+
+    Recorder::~Recorder()
+    {
+      Recorder *expected = this;
+      fatal.compare_exchange_strong(expected, nullptr);
+
+      if(Logger::getRecorder() == this)
+      {
+        Logger::setRecorder(nullptr);
+      }
+
+      munmap(header, size);
+    }
+
+    void Recorder::write(const Overkiz::Log::Priority priority, const char *ident, const char *text)
+    {
+      size_t identLength = ident && *ident ? strlen(ident) : 0;
+      size_t textLength = strlen(text);
+      size_t limit = header->capacity / 2 - sizeof(Entry);
+
+      //A message never fills the ring
+      identLength = std::min(identLength, limit / 2);
+      textLength = std::min(textLength, limit - identLength - 2);
+
+      Entry entry;
+      entry.length = identLength ? identLength + 2 + textLength : textLength;
+      entry.size = (sizeof(Entry) + entry.length + 7) & ~7U;
+      entry.commit = 0;
+      entry.offset = header->head.fetch_add(entry.size, std::memory_order_relaxed);
+      entry.priority = priority;
+
+      //The order of the entries is kept by their offset, the tick resolution is enough
+      struct timespec now;
+      clock_gettime(CLOCK_REALTIME_COARSE, &now);
+      entry.time = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+      uint64_t position = entry.offset;
+      copy(position, &entry, sizeof(entry));
+      position += sizeof(entry);
+
+      if(identLength)
+      {
+        copy(position, ident, identLength);
+        copy(position + identLength, ": ", 2);
+        position += identLength + 2;
+      }
+
+      copy(position, text, textLength);
+
+      //The first 8 bytes of an entry are never split by the end of the ring
+      uint32_t *commit = reinterpret_cast<uint32_t *>(data + entry.offset % header->capacity) + 1;
+      __atomic_store_n(commit, key(entry), __ATOMIC_RELEASE);
+    }
+
+    void Recorder::vwrite(const Overkiz::Log::Priority priority, const char *ident, const char *format,
+                          va_list arguments)
+    {
+      char text[LOG_MAX_MESSAGE_SIZE];
+      vsnprintf(text, sizeof(text), format, arguments);
+      write(priority, ident, text);
+    }
+
+    void Recorder::dump(int fd) const
+    {
+      dump(header, fd);
+    }
+
+    void Recorder::handleFatalSignals()
+    {
+      static __thread void *altStack = nullptr;
+      static const int signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+      stack_t stack;
+
+      //A stack overflow must not prevent the dump
+      if(!altStack && sigaltstack(nullptr, &stack) == 0 && (stack.ss_flags & SS_DISABLE))
+      {
+        altStack = malloc(ALT_STACK_SIZE);
+
+        if(altStack)
+        {
+          stack.ss_sp = altStack;
+          stack.ss_size = ALT_STACK_SIZE;
+          stack.ss_flags = 0;
+          sigaltstack(&stack, nullptr);
+        }
+      }
+
+      fatal = this;
+      struct sigaction action;
+      memset(&action, 0, sizeof(action));
+      action.sa_sigaction = &Recorder::crash;
+      action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESETHAND;
+      sigemptyset(&action.sa_mask);
+
+      for(size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+      {
+        if(sigaction(signals[i], &action, nullptr) != 0)
+        {
+          throw Overkiz::Errno::Exception();
+        }
+      }
+    }
+
+    bool Recorder::dump(const std::string& path, int fd)
+    {
+      int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+      if(file == -1)
+      {
+        return false;
+      }
+
+      struct stat st;
+      void *mapping = MAP_FAILED;
+
+      if(fstat(file, &st) == 0 && (size_t) st.st_size >= sizeof(Header))
+      {
+        mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, file, 0);
+      }
+
+      close(file);
+
+      if(mapping == MAP_FAILED)
+      {
+        return false;
+      }
+
+      const Header *ring = static_cast<const Header *>(mapping);
+      bool valid = memcmp(ring->magic, LOG_RECORDER_MAGIC, sizeof(ring->magic)) == 0
+                   && ring->version == RECORDER_VERSION && ring->capacity > 0 && ring->capacity % 8 == 0
+                   && ring->capacity <= st.st_size - sizeof(Header);
+
+      if(valid)
+      {
+        dump(ring, fd);
+      }
+
+      munmap(mapping, st.st_size);
+      return valid;
+    }
+
+    void Recorder::copy(uint64_t position, const void *source, size_t length)
+    {
+      size_t index = position % header->capacity;
+      size_t first = std::min(length, (size_t)(header->capacity - index));
+      memcpy(data + index, source, first);
+      memcpy(data, static_cast<const char *>(source) + first, length - first);
+    }
+
+    void Recorder::copy(const char *ring, uint64_t capacity, uint64_t position, void *destination, size_t length)
+    {
+      size_t index = position % capacity;
+      size_t first = std::min(length, (size_t)(capacity - index));
+      memcpy(destination, ring + index, first);
+      memcpy(static_cast<char *>(destination) + first, ring, length - first);
+    }
+
+    void Recorder::dump(const Header *ring, int fd)
+    {
+      //Static to keep the stack of a signal handler small
+      static char line[LOG_MAX_MESSAGE_SIZE + 128];
+      const char *entries = reinterpret_cast<const char *>(ring + 1);
+      uint64_t capacity = ring->capacity;
+      uint64_t end = ring->head.load(std::memory_order_acquire);
+      uint64_t position = end > capacity ? end - capacity : 0;
+
+      while(position + sizeof(Entry) <= end)
+      {
+        Entry entry;
+        copy(entries, capacity, position, &entry, sizeof(entry));
+
+        //Overwritten, torn or uncommitted entry: look for the next one
+        if(entry.offset != position || entry.size < sizeof(Entry) || entry.size % 8 || entry.size > capacity
+           || position + entry.size > end || entry.length > entry.size - sizeof(Entry) || entry.commit != key(entry))
+        {
+          position += 8;
+          continue;
+        }
+
+        size_t used = 0;
+        int priority = entry.priority >= 0 && entry.priority < OVK_PRIORITY_COUNT ? entry.priority : OVK_PRIORITY_COUNT;
+        const char *name = priority < OVK_PRIORITY_COUNT ? PRIORITY_STRING_UC[priority].c_str() : "UNKNOWN";
+        append(line, used, sizeof(line), entry.time / 1000000000ULL, 1);
+        append(line, used, sizeof(line), ".", 1);
+        append(line, used, sizeof(line), entry.time % 1000000000ULL / 1000, 6);
+        append(line, used, sizeof(line), " ", 1);
+        append(line, used, sizeof(line), name, strlen(name));
+        append(line, used, sizeof(line), " ", 1);
+
+        size_t length = std::min((size_t) entry.length, sizeof(line) - used - 1);
+        copy(entries, capacity, position + sizeof(Entry), line + used, length);
+        used += length;
+        line[used++] = '\n';
+        output(fd, line, used);
+        position += entry.size;
+      }
+    }
+
+    uint32_t Recorder::key(const Entry& entry)
+    {
+      return RECORDER_KEY ^ entry.size ^ entry.length ^ (uint32_t) entry.offset ^ (uint32_t)(entry.offset >> 32);
+    }
+
+    void Recorder::crash(int sig, siginfo_t *info, void *context)
+    {
+      Recorder *recorder = fatal.load();
+
+      if(recorder)
+      {
+        static const char banner[] = "Fatal signal, last log messages:\n";
+        output(STDERR_FILENO, banner, sizeof(banner) - 1);
+        recorder->dump(STDERR_FILENO);
+      }
+
+      //The default action has been restored
+      raise(sig);
+    }
+
+  }
+
+}
@@ -0,0 +1,372 @@
+/*
+ * LogSink.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <algorithm>
+
+#include "LogSink.h"
+
+//Attempts and poll timeout in ms when the socket is full
+#define LOG_SEND_RETRIES 3
+#define LOG_SEND_TIMEOUT 10
+
+namespace Overkiz
+{
+
+  namespace Log
+  {
+
+    namespace
+    {
+
+      /**
+       * Time stamp of the current second, formatted once per thread.
+       */
+      struct Stamp
+      {
+        time_t second;
+        Sink::Format format;
+        char date[32];
+        char zone[8];
+      };
+
+      __thread Stamp stamp = {-1, Sink::RFC3164, {0}, {0}};
+
+      void update(const struct timespec& now, Sink::Format format)
+      {
+        if(stamp.second == now.tv_sec && stamp.format == format)
+        {
+          return;
+        }
+
+        struct tm local;
+        localtime_r(&now.tv_sec, &local);
+        stamp.second = now.tv_sec;
+        stamp.format = format;
+
+        if(format == Sink::RFC3164)
+        {
+          strftime(stamp.date, sizeof(stamp.date), "%h %e %T", &local);
+          return;
+        }
+
+        strftime(stamp.date, sizeof(stamp.date), "%Y-%m-%dT%H:%M:%S", &local);
+        long offset = local.tm_gmtoff / 60;
+        snprintf(stamp.zone, sizeof(stamp.zone), "%c%02ld:%02ld", offset < 0 ? '-' : '+', labs(offset) / 60,
+                 labs(offset) % 60);
+      }
+
+    }
+
+    Sink::Batch::Batch() :
+      count(0)
+    {
+      memset(headers, 0, sizeof(headers));
+
+      for(size_t i = 0; i < BATCH_SIZE; i++)
+      {
+        vectors[i].iov_base = packets[i];
+        headers[i].msg_hdr.msg_iov = &vectors[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+      }
+    }
+
+    Sink::Batch::~Batch()
+    {
+    }
+
+    bool Sink::Batch::add(int priority, const char *ident, int options, const char *message)
+    {
+      if(count == BATCH_SIZE)
+      {
+        return false;
+      }
+
+      vectors[count].iov_len = Sink::get().format(packets[count], priority, ident, options, "%s", message);
+      count++;
+      return true;
+    }
+
+    bool Sink::Batch::empty() const
+    {
+      return count == 0;
+    }
+
+    bool Sink::Batch::full() const
+    {
+      return count == BATCH_SIZE;
+    }
+
+    Sink& Sink::get()
+    {
+      static Sink sink;
+      return sink;
+    }
+
+    Sink::Sink() :
+      fd(-1), style(RFC3164), path(LOG_SOCKET_PATH)
+    {
+      char name[HOST_NAME_MAX + 1];
+
+      if(gethostname(name, sizeof(name)) == 0)
+      {
+        name[HOST_NAME_MAX] = '\0';
+        hostname = name;
+      }
+      else
+      {
+        hostname = "-";
+      }
+    }
+
+    Sink::~Sink()
+    {
+      if(fd != -1)
+      {
+        close(fd);
+      }
+    }
+
+    void Sink::write(int priority, const char *ident, int options, const char *message)
+    {
+      char packet[LOG_MAX_PACKET_SIZE];
+      struct iovec vector;
+      struct mmsghdr header;
+      memset(&header, 0, sizeof(header));
+      vector.iov_base = packet;
+      vector.iov_len = format(packet, priority, ident, options, "%s", message);
+      header.msg_hdr.msg_iov = &vector;
+      header.msg_hdr.msg_iovlen = 1;
+      send(&header, 1);
+    }
+
+    void Sink::vwrite(int priority, const char *ident, int options, const char *format, va_list arguments)
+    {
+      char packet[LOG_MAX_PACKET_SIZE];
+      struct iovec vector;
+      struct mmsghdr header;
+      memset(&header, 0, sizeof(header));
+      vector.iov_base = packet;
+      vector.iov_len = vformat(packet, priority, ident, options, format, arguments);
+      header.msg_hdr.msg_iov = &vector;
+      header.msg_hdr.msg_iovlen = 1;
+      send(&header, 1);
+    }
+
+    void Sink::write(Batch& batch)
+    {
+      if(batch.count)
+      {
+        send(batch.headers, batch.count);
+        batch.count = 0;
+      }
+    }
+
+    void Sink::setPath(const std::string& socketPath)
+    {
+      lock.acquire();
+      path = socketPath;
+      int socket = fd;
+
+      //Disconnect the socket, the next send fails and reconnects it to the new path
+      if(socket != -1)
+      {
+        struct sockaddr address;
+        memset(&address, 0, sizeof(address));
+        address.sa_family = AF_UNSPEC;
+        ::connect(socket, &address, sizeof(address));
+      }
+
+      lock.release();
+    }
+
+    std::string Sink::getPath()
+    {
+      lock.acquire();
+      std::string socketPath = path;
+      lock.release();
+      return socketPath;
+    }
+
+    void Sink::setFormat(Format format)
+    {
+      style = format;
+    }
+
+    Sink::Format Sink::getFormat() const
+    {
+      return style;
+    }
+
+    size_t Sink::vformat(char *packet, int priority, const char *ident, int options, const char *format,
+                         va_list arguments)
+    {
+      //The header may change errno, which is needed by a %m conversion
+      int error = errno;
+      struct timespec now;
+      clock_gettime(CLOCK_REALTIME, &now);
+      Format current = style.load(std::memory_order_relaxed);
+      update(now, current);
+      int length;
+
+      if(!ident || !*ident)
+      {
+        ident = program_invocation_short_name;
+      }
+
+      if(current == RFC5424)
+      {
+        length = snprintf(packet, LOG_MAX_PACKET_SIZE, "<%d>1 %s.%06ld%s %s %s %d - - ", priority, stamp.date,
+                          now.tv_nsec / 1000, stamp.zone, hostname.c_str(), ident, getpid());
+      }
+      else if(options & LOG_PID)
+      {
+        length = snprintf(packet, LOG_MAX_PACKET_SIZE, "<%d>%s %s[%d]: ", priority, stamp.date, ident, getpid());
+      }
+      else
+      {
+        length = snprintf(packet, LOG_MAX_PACKET_SIZE, "<%d>%s %s: ", priority, stamp.date, ident);
+      }
+
+      if(length < 0 || length >= LOG_MAX_PACKET_SIZE)
+      {
+        return 0;
+      }
+
+      //The message is truncated to LOG_MAX_MESSAGE_SIZE as the header has less than its reserved size
+      errno = error;
+      int size = vsnprintf(packet + length, std::min(LOG_MAX_PACKET_SIZE - length, LOG_MAX_MESSAGE_SIZE), format,
+                           arguments);
+
+      if(size > 0)
+      {
+        length += std::min(size, std::min(LOG_MAX_PACKET_SIZE - length, LOG_MAX_MESSAGE_SIZE) - 1);
+      }
+
+      return length;
+    }
+
+    size_t Sink::format(char *packet, int priority, const char *ident, int options, const char *format, ...)
+    {
+      va_list arguments;
+      va_start(arguments, format);
+      size_t length = vformat(packet, priority, ident, options, format, arguments);
+      va_end(arguments);
+      return length;
+    }
+
+    void Sink::send(struct mmsghdr *headers, size_t count)
+    {
+      int error = errno;
+      int socket = fd.load(std::memory_order_relaxed);
+      bool reconnected = false;
+      int retries = 0;
+      size_t sent = 0;
+
+      if(socket == -1)
+      {
+        socket = connect(-1);
+        reconnected = true;
+      }
+
+      while(socket != -1 && sent < count)
+      {
+        int ret = sendmmsg(socket, headers + sent, count - sent, MSG_NOSIGNAL);
+
+        if(ret > 0)
+        {
+          sent += ret;
+        }
+        else if(ret == 0)
+        {
+          break;
+        }
+        else if(errno == EINTR)
+        {
+        }
+        else if(errno == EAGAIN || errno == ENOBUFS)
+        {
+          //The daemon is late, wait a little before dropping the packets
+          if(retries++ == LOG_SEND_RETRIES)
+          {
+            break;
+          }
+
+          struct pollfd event;
+          event.fd = socket;
+          event.events = POLLOUT;
+          poll(&event, 1, LOG_SEND_TIMEOUT);
+        }
+        else if(errno == EMSGSIZE)
+        {
+          sent++;
+        }
+        else if(!reconnected)
+        {
+          //The daemon may have been restarted
+          reconnected = true;
+          socket = connect(socket);
+        }
+        else
+        {
+          break;
+        }
+      }
+
+      errno = error;
+    }
+
+    int Sink::connect(int broken)
+    {
+      lock.acquire();
+      int socket = fd;
+
+      //Another thread may have reconnected it
+      if(socket == broken)
+      {
+        socket = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+        if(socket != -1)
+        {
+          struct sockaddr_un address;
+          memset(&address, 0, sizeof(address));
+          address.sun_family = AF_UNIX;
+          strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+          if(::connect(socket, (struct sockaddr *) &address, sizeof(address)) != 0)
+          {
+            close(socket);
+            socket = -1;
+          }
+        }
+
+        if(broken == -1)
+        {
+          fd = socket;
+        }
+        else if(socket != -1)
+        {
+          //Other threads may be sending on the broken socket without the lock, its number is never released
+          int replaced = dup3(socket, broken, O_CLOEXEC);
+          close(socket);
+          socket = replaced;
+        }
+      }
+
+      lock.release();
+      return socket;
+    }
+
+  }
+
+}
@@ -27,24 +27,38 @@ namespace Overkiz
       {
         unsigned long *stack = (unsigned long *)((unsigned long) stk & ~(15UL));
         stack[0] = (unsigned long) execute; //execute
-        //        stack[-1] = (unsigned long)0;//esp
-        stack[-2] = (unsigned long) execute; //eip
+        stack[-1] = (unsigned long) 0; //old sp
+        stack[-2] = (unsigned long) execute; //old pc
         stack[-3] = (unsigned long) launcher; //launcher
+        stack[-4] = (unsigned long) 0; //caller sp
+        stack[-5] = (unsigned long) 0; //padding
+        stack[-6] = (unsigned long) 0; //fp[0], caller lr
+        stack[-7] = (unsigned long) 0; //fp[-1], caller r11
         return stack;
       }
 
+      /*
+       * Same layout as x86_64: the top of a coroutine stack holds the frame
+       * record of the last resume call, the r11 of the caller followed by
+       * the return address, as pushed by a prologue in ARM state. The CFI of
+       * resume describes the caller registers through this record and r11
+       * points to it before launching.
+       */
       __attribute__((naked)) void resume(void *stk)
       {
         asm("sub r1, r0, #12");
         asm("ldmfd r1, {r0, r2, r3}");
         CFI(asm(".cfi_remember_state"));
-        asm("sub r1, r1, #4");
-        asm("stmfd r1!, {r4-r11, sp, lr}");
-        asm(".save {r4-r11, sp, lr}");
+        asm("str sp, [r1, #-4]");
+        asm("sub r1, r1, #8");
+        asm("stmfd r1!, {r4-r11, lr}");
+        asm(".save {sp}");
+        asm(".pad #4");
+        asm(".save {r4-r11, lr}");
         asm("mov sp, r1");
         CFI(asm(".cfi_def_cfa sp, 40"));
-        CFI(asm(".cfi_offset lr, -4"));
-        CFI(asm(".cfi_offset sp, -8"));
+        CFI(asm(".cfi_offset sp, 0"));
+        CFI(asm(".cfi_offset lr, -8"));
         CFI(asm(".cfi_offset r11, -12"));
         CFI(asm(".cfi_offset r10, -16"));
         CFI(asm(".cfi_offset r9, -20"));
@@ -53,6 +67,7 @@ namespace Overkiz
         CFI(asm(".cfi_offset r6, -32"));
         CFI(asm(".cfi_offset r5, -36"));
         CFI(asm(".cfi_offset r4, -40"));
+        asm("add r11, sp, #32");
         asm("ldr r4, =yield_ret");
         asm("str r4, [r1, #48]");
         #if (defined(__VFP_FP__) && !defined(__SOFTFP__))
@@ -104,7 +119,7 @@ namespace Overkiz
         CFI(asm(".cfi_restore s31"));
         #endif
         asm("mov r1, sp");
-        asm("ldmfd r1!, {r4-r11, sp, lr}");
+        asm("ldmfd r1!, {r4-r11, lr}");
         CFI(asm(".cfi_restore r4"));
         CFI(asm(".cfi_restore r5"));
         CFI(asm(".cfi_restore r6"));
@@ -113,9 +128,10 @@ namespace Overkiz
         CFI(asm(".cfi_restore r9"));
         CFI(asm(".cfi_restore r10"));
         CFI(asm(".cfi_restore r11"));
-        CFI(asm(".cfi_restore sp"));
         CFI(asm(".cfi_restore lr"));
-        asm("add r1, r1, #16");
+        asm("ldr sp, [r1, #4]");
+        CFI(asm(".cfi_restore sp"));
+        asm("add r1, r1, #20");
         CFI(asm(".cfi_restore_state"));
         asm("stmfd r1, {r2, r3}");
         asm("bx lr");
@@ -34,30 +34,31 @@ namespace Overkiz
         stack[-5] = (unsigned long) 0; //old esi
         stack[-6] = (unsigned long) 0; //old edi
         stack[-7] = (unsigned long) 0; //old cw
-        stack[-8] = (unsigned long) 0; //padding
-        stack[-9] = (unsigned long) 0; //esp[2]
-        stack[-10] = (unsigned long) 0; //esp[1]
-        stack[-11] = (unsigned long) 0; //esp[0]
-        stack[-12] = (unsigned long) launcher; //first arg
+        stack[-8] = (unsigned long) 0; //new cw
+        stack[-9] = (unsigned long) launcher; //arg storage
+        stack[-10] = (unsigned long) 0; //esp[2], caller return address
+        stack[-11] = (unsigned long) 0; //esp[1], caller ebp
+        stack[-12] = (unsigned long) launcher; //esp[0], first arg
         return stack;
       }
 
-      void resume(void *stk)
+      /*
+       * Same layout as x86_64: the top of a coroutine stack holds the frame
+       * record of the last resume call, the saved ebp of the caller at
+       * esp[1] and the return address at esp[2], above the argument of the
+       * launched function. The CFI of resume describes the caller registers
+       * through this record and ebp points to it before launching.
+       * The functions are naked: the layout must not depend on a prologue.
+       */
+      __attribute__((naked)) void resume(void *stk)
       {
-        asm("movl %0, %%eax" : : "m"(stk));
-        asm("movl %esp, %edx");
-        asm("addl $4, %edx");
-        asm("cmpl %esp, %ebp");
-        asm("jne 1f");
-        asm("addl $4, %edx");
-        asm("1:");
-        asm("movl %edx, -36(%eax)");
+        asm("movl 4(%esp), %eax");
+        asm("movl %ebp, -44(%eax)");
         asm("movl (%esp), %edx");
-        asm("movl %edx, -44(%eax)");
-        asm("movl -8(%eax), %ecx");
-        asm("movl %esp, -8(%eax)");
-        asm("movl 4(%esp), %edx");
         asm("movl %edx, -40(%eax)");
+        asm("movl -8(%eax), %ecx");
+        asm("leal 4(%esp), %edx");
+        asm("movl %edx, -8(%eax)");
         asm("movl -4(%eax), %edx");
         asm("movl $2f, -4(%eax)");
         CFI(asm(".cfi_remember_state"));
@@ -70,10 +71,13 @@ namespace Overkiz
         asm("fldcw -32(%eax)");
         asm("subl $48, %eax");
         asm("movl %eax, %esp");
-        CFI(asm(".cfi_def_cfa_register esp"));
-        CFI(asm(".cfi_adjust_cfa_offset 4"));
-        CFI(asm(".cfi_rel_offset esp, 12"));
+        CFI(asm(".cfi_def_cfa esp, 12"));
+        CFI(asm(".cfi_offset ebp, -8"));
+        CFI(asm(".cfi_rel_offset esp, 40"));
+        asm("leal 4(%esp), %ebp");
         asm("call *%edx");
+        asm("movl 12(%esp), %eax");
+        asm("movl %eax, (%esp)");
         asm("movl 48(%esp), %edx");
         asm("movl %esp, %ecx");
         asm("2:");
@@ -85,20 +89,17 @@ namespace Overkiz
         asm("movl -16(%eax), %ebx");
         asm("movl -12(%eax), %ebp");
         asm("movl -8(%eax), %esp");
+        asm("subl $4, %esp");
         CFI(asm(".cfi_restore_state"));
         asm("movl %edx, -4(%eax)");
         asm("movl %ecx, -8(%eax)");
+        asm("ret");
       }
 
-      void yield(void *stk)
+      __attribute__((naked)) void yield(void *stk)
       {
-        asm("movl %0, %%eax" : : "m"(stk));
-        asm("movl %eax, %edx");
-        asm("subl $48, %edx");
-        asm("movl -4(%eax), %eax");
-        CFI(asm(".cfi_remember_state"));
+        asm("movl 4(%esp), %eax");
         asm("subl $20, %esp");
-        CFI(asm(".cfi_def_cfa_register esp"));
         CFI(asm(".cfi_adjust_cfa_offset 20"));
         asm("movl %ebp, 16(%esp)");
         asm("movl %ebx, 12(%esp)");
@@ -106,13 +107,15 @@ namespace Overkiz
         asm("movl %edi, 4(%esp)");
         asm("fnstcw  (%esp)");
         asm("movl %esp, %ecx");
+        CFI(asm(".cfi_remember_state"));
         CFI(asm(".cfi_def_cfa_register ecx"));
-        asm("movl %edx, %esp");
+        asm("leal -48(%eax), %esp");
         asm("movl $1f, %edx");
+        asm("movl -4(%eax), %eax");
         asm("jmp *%eax");
         asm("1:");
         asm("movl %ecx, %esp");
-        CFI(asm(".cfi_def_cfa_register esp"));
+        CFI(asm(".cfi_restore_state"));
         asm("fldcw (%esp)");
         asm("movl 4(%esp), %edi");
         asm("movl 8(%esp), %esi");
@@ -120,7 +123,7 @@ namespace Overkiz
         asm("movl 16(%esp), %ebp");
         asm("addl $20, %esp");
         CFI(asm(".cfi_adjust_cfa_offset -20"));
-        CFI(asm(".cfi_restore_state"));
+        asm("ret");
       }
 
     }
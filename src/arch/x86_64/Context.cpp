@@ -37,25 +37,29 @@ namespace Overkiz
         stack[-8] = (unsigned long) 0; //old r14
         stack[-9] = (unsigned long) 0; //old r15
         stack[-10] = (unsigned long) 0; //old cw
-        stack[-11] = (unsigned long) 0; //rsp[1]
-        stack[-12] = (unsigned long) 0; //rsp[0]
+        stack[-11] = (unsigned long) 0; //rsp[1], caller return address
+        stack[-12] = (unsigned long) 0; //rsp[0], caller rbp
         return stack;
       }
 
-      void resume(void *stk)
+      /*
+       * The top of a coroutine stack mirrors the frame record of the last
+       * resume call: the saved rbp of the caller at rsp[0] and the return
+       * address at rsp[1]. The CFI of resume describes the caller registers
+       * through this record and the bottom frame of the coroutine points to
+       * it with rbp, so DWARF unwinders (gdb, libunwind, backtrace) and frame
+       * pointer walkers (perf --call-graph fp) both go from a coroutine back
+       * to the code which resumed it.
+       * The functions are naked: the layout must not depend on a prologue.
+       */
+      __attribute__((naked)) void resume(void *stk)
       {
+        asm("movq %rbp, -96(%rdi)");
         asm("movq (%rsp), %rdx");
-        asm("movq %rdx, -96(%rdi)");
+        asm("movq %rdx, -88(%rdi)");
         asm("movq -24(%rdi), %rcx");
-        asm("movq %rsp, %rax");
-        asm("addq $8, %rax");
-        asm("cmpq %rsp, %rbp");
-        asm("jne 1f");
-        asm("addq $8, %rax");
-        asm("1:");
+        asm("leaq 8(%rsp), %rax");
         asm("movq %rax, -24(%rdi)");
-        asm("movq 8(%rsp), %rdx");
-        asm("movq %rdx, -88(%rdi)");
         asm("movq -16(%rdi), %rdx");
         asm("leaq 2f(%rip), %rax");
         asm("movq %rax, -16(%rdi)");
@@ -71,8 +75,10 @@ namespace Overkiz
         asm("fldcw -8(%rsp)");
         asm("subq $96, %rdi");
         asm("movq %rdi, %rsp");
-        CFI(asm(".cfi_def_cfa_register rsp"));
+        CFI(asm(".cfi_def_cfa rsp, 16"));
+        CFI(asm(".cfi_offset rbp, -16"));
         CFI(asm(".cfi_rel_offset rsp, 72"));
+        asm("movq %rsp, %rbp");
         asm("movq 88(%rdi), %rdi");
         asm("call *%rdx");
         asm("movq 96(%rsp), %rdx");
@@ -88,18 +94,15 @@ namespace Overkiz
         asm("movq -40(%rdi), %rbx");
         asm("movq -32(%rdi), %rbp");
         asm("movq -24(%rdi), %rax");
-        asm("subq $16, %rax");
-        asm("cmpq %rax, %rbp");
-        asm("je 3f");
-        asm("addq $8, %rax");
-        asm("3:");
+        asm("subq $8, %rax");
         asm("movq %rax, %rsp");
         CFI(asm(".cfi_restore_state"));
         asm("movq %rdx, -16(%rdi)");
         asm("movq %rcx, -24(%rdi)");
+        asm("ret");
       }
 
-      void yield(void *stk)
+      __attribute__((naked)) void yield(void *stk)
       {
         asm("movq %rbp, -8(%rsp)");
         asm("movq %rbx, -16(%rsp)");
@@ -126,8 +129,8 @@ namespace Overkiz
         asm("movq -32(%rsp), %r13");
         asm("movq -24(%rsp), %r12");
         asm("movq -16(%rsp), %rbx");
-        CFI(asm(".cfi_restore rbx"));
         asm("movq -8(%rsp), %rbp");
+        asm("ret");
       }
 
     }
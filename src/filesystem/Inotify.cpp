@@ -132,6 +132,11 @@ namespace Overkiz
       stop();
   }
 
+  size_t InotifyManager::clients() const
+  {
+    return instances.size();
+  }
+
   void InotifyManager::process(uint32_t events)
   {
     if(events & EPOLLERR)
@@ -0,0 +1,38 @@
+/*
+ * Channel.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include "Channel.h"
+
+namespace Overkiz
+{
+
+  Coroutine::Timeout::Timeout(Waiter& timeoutWaiter,
+                              const Time::Monotonic& deadline) :
+    Timer::Monotonic(deadline, false), waiter(timeoutWaiter), fired(false)
+  {
+    start();
+  }
+
+  Coroutine::Timeout::~Timeout()
+  {
+  }
+
+  bool Coroutine::Timeout::isExpired() const
+  {
+    return fired;
+  }
+
+  Time::Monotonic Coroutine::Timeout::deadline(const Time::Monotonic& timeout)
+  {
+    return Time::Monotonic::now() + timeout;
+  }
+
+  void Coroutine::Timeout::expired(const Time::Monotonic& time)
+  {
+    fired = waiter.notify(nullptr);
+  }
+
+}
@@ -7,6 +7,7 @@
 #include <config.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <cerrno>
 #include <cstring>
 #include <cstdio>
 
@@ -37,7 +38,7 @@ namespace Overkiz
   }
   #endif
 
-  Coroutine::Coroutine(size_t initsize)
+  Coroutine::Coroutine(size_t initsize, unsigned stackOptions)
   {
     state = Status::STOPPED;
     int pgsize = getpagesize();
@@ -52,8 +53,9 @@ namespace Overkiz
     }
 
     size += (2 * MPROTECT_SIZE * pgsize);
+    options = stackOptions & (PREFAULTED | LOCKED);
     stack.base = mmap(nullptr, size, PROT_READ | PROT_WRITE,
-                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                      MAP_PRIVATE | MAP_ANONYMOUS | (options & PREFAULTED ? MAP_POPULATE : 0), -1, 0);
 
     if(stack.base == MAP_FAILED)
     {
@@ -63,6 +65,15 @@ namespace Overkiz
     mprotect(stack.base, MPROTECT_SIZE * pgsize, PROT_NONE);
     mprotect((unsigned char *) stack.base + size - (MPROTECT_SIZE * pgsize),
              MPROTECT_SIZE * pgsize, PROT_NONE);
+
+    //mlock also faults the pages in
+    if((options & LOCKED)
+       && mlock((unsigned char *) stack.base + (MPROTECT_SIZE * pgsize),
+                size - (2 * MPROTECT_SIZE * pgsize)) != 0)
+    {
+      OVK_WARNING("Couldn't lock coroutine stack: %s.", strerror(errno));
+      options &= ~LOCKED;
+    }
     #ifdef VALGRIND
     valgrind = VALGRIND_STACK_REGISTER(
                  (unsigned char *)stack.base + (MPROTECT_SIZE * pgsize),
@@ -88,6 +99,7 @@ namespace Overkiz
     stack.base = nullptr;
     stack.top = nullptr;
     size = 0;
+    options = 0;
     state = Status::RUNNING;
     #ifdef VALGRIND
     valgrind = 0;
@@ -102,6 +114,7 @@ namespace Overkiz
 
   Coroutine::~Coroutine()
   {
+    clear();
     #ifdef VALGRIND
     VALGRIND_STACK_DEREGISTER(valgrind);
     #endif
@@ -178,6 +191,7 @@ namespace Overkiz
 
       #endif
       coro->state = Status::RUNNING;
+      coro->resumed();
     }
     else
     {
@@ -186,10 +200,38 @@ namespace Overkiz
     }
   }
 
+  bool Coroutine::maybeYield()
+  {
+    Shared::Pointer<Coroutine>& coro = *current;
+
+    if(coro.empty() || !coro->preempt() || !coro->reschedule())
+    {
+      return false;
+    }
+
+    yield();
+    return true;
+  }
+
+  void Coroutine::wake(Shared::Pointer<Coroutine>& coro)
+  {
+    if(coro->state != Status::PAUSED)
+    {
+      OVK_ERROR("Coroutine is not paused. Couldn't wake.");
+      throw Coroutine::Exception();
+    }
+
+    if(!coro->reschedule())
+    {
+      resume(coro);
+    }
+  }
+
   void Coroutine::launch()
   {
     state = Status::RUNNING;
     entry();
+    clear();
     state = Status::STOPPED;
   }
 
@@ -213,6 +255,224 @@ namespace Overkiz
     return size - (2 * getpagesize());
   }
 
+  unsigned Coroutine::stackOptions() const
+  {
+    return options;
+  }
+
+  Coroutine::Storage& Coroutine::localStorage(size_t slot)
+  {
+    if(slot >= locals.size())
+    {
+      Storage empty = { nullptr, nullptr };
+      locals.resize(slot + 1, empty);
+    }
+
+    return locals[slot];
+  }
+
+  void Coroutine::clear()
+  {
+    //A value destructor may access other local values
+    while(!locals.empty())
+    {
+      std::vector<Storage> values;
+      values.swap(locals);
+
+      for(auto & storage : values)
+      {
+        if(storage.value)
+        {
+          storage.destroy(storage.value);
+        }
+      }
+    }
+  }
+
+  size_t Coroutine::reserve()
+  {
+    return slots++;
+  }
+
+  Coroutine::Waiter::Waiter() :
+    coroutine(*current), source(nullptr), notified(false), suspended(false)
+  {
+    if(coroutine.empty() || !coroutine->stack.base)
+    {
+      OVK_ERROR("Coroutine not supported.");
+      throw Coroutine::Exception();
+    }
+  }
+
+  Coroutine::Waiter::~Waiter()
+  {
+  }
+
+  void Coroutine::Waiter::suspend()
+  {
+    suspended = true;
+
+    try
+    {
+      //The coroutine may be resumed by someone else
+      while(!notified)
+      {
+        Coroutine::yield();
+      }
+    }
+    catch(...)
+    {
+      suspended = false;
+      throw;
+    }
+
+    suspended = false;
+  }
+
+  bool Coroutine::Waiter::notify(const WaitQueue *queue)
+  {
+    if(notified)
+    {
+      return false;
+    }
+
+    notified = true;
+    source = queue;
+
+    if(suspended && coroutine->state == Status::PAUSED)
+    {
+      //The waiter may be destroyed by its coroutine once woken
+      Shared::Pointer<Coroutine> coro = coroutine;
+      Coroutine::wake(coro);
+    }
+
+    return true;
+  }
+
+  bool Coroutine::Waiter::isNotified() const
+  {
+    return notified;
+  }
+
+  const Coroutine::WaitQueue *Coroutine::Waiter::getSource() const
+  {
+    return source;
+  }
+
+  Coroutine::WaitQueue::Node::Node() :
+    waiter(nullptr), queue(nullptr), prev(nullptr), next(nullptr)
+  {
+  }
+
+  Coroutine::WaitQueue::Node::Node(Waiter& waiter, WaitQueue& queue) :
+    Node()
+  {
+    link(waiter, queue);
+  }
+
+  Coroutine::WaitQueue::Node::~Node()
+  {
+    unlink();
+  }
+
+  void Coroutine::WaitQueue::Node::link(Waiter& newWaiter, WaitQueue& newQueue)
+  {
+    unlink();
+    waiter = &newWaiter;
+    queue = &newQueue;
+    prev = queue->tail;
+    next = nullptr;
+
+    if(queue->tail)
+    {
+      queue->tail->next = this;
+    }
+    else
+    {
+      queue->head = this;
+    }
+
+    queue->tail = this;
+  }
+
+  void Coroutine::WaitQueue::Node::unlink()
+  {
+    if(queue)
+    {
+      if(prev)
+      {
+        prev->next = next;
+      }
+      else
+      {
+        queue->head = next;
+      }
+
+      if(next)
+      {
+        next->prev = prev;
+      }
+      else
+      {
+        queue->tail = prev;
+      }
+
+      queue = nullptr;
+      prev = nullptr;
+      next = nullptr;
+    }
+  }
+
+  Coroutine::WaitQueue::WaitQueue() :
+    head(nullptr), tail(nullptr)
+  {
+  }
+
+  Coroutine::WaitQueue::~WaitQueue()
+  {
+    while(head)
+    {
+      head->unlink();
+    }
+  }
+
+  void Coroutine::WaitQueue::wait()
+  {
+    Waiter waiter;
+    Node node(waiter, *this);
+    waiter.suspend();
+  }
+
+  bool Coroutine::WaitQueue::notify()
+  {
+    while(head)
+    {
+      Node *node = head;
+      node->unlink();
+
+      if(node->waiter->notify(this))
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void Coroutine::WaitQueue::notifyAll()
+  {
+    while(notify())
+    {
+    }
+  }
+
+  bool Coroutine::WaitQueue::empty() const
+  {
+    return head == nullptr;
+  }
+
   Thread::Key<Coroutine> Coroutine::current;
 
+  std::atomic<size_t> Coroutine::slots(0);
+
 }
@@ -107,6 +107,11 @@ namespace Overkiz
       wevents.erase(it);
   }
 
+  size_t Event::Manager::clients() const
+  {
+    return wevents.size();
+  }
+
   void Event::Manager::process(uint32_t evts)
   {
     if(evts & EPOLLOUT)
@@ -0,0 +1,36 @@
+/*
+ * Inspector.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <kizbox/framework/core/Log.h>
+#include "Inspector.h"
+
+namespace Overkiz
+{
+
+  Poller::Inspector::Inspector(uint32_t inspectSignal) :
+    signal(inspectSignal)
+  {
+    Signal::Manager::add(signal, this);
+  }
+
+  Poller::Inspector::~Inspector()
+  {
+    Signal::Manager::remove(signal, this);
+  }
+
+  void Poller::Inspector::handle(const Overkiz::Signal& received)
+  {
+    std::vector<Registration> registrations = Poller::get()->snapshot();
+
+    OVK_NOTICE("Poller of thread %lu, %zu watchers:", (unsigned long) pthread_self(), registrations.size());
+
+    for(auto& registration : registrations)
+    {
+      OVK_NOTICE("  %s", registration.toString().c_str());
+    }
+  }
+
+}
@@ -5,16 +5,30 @@
  */
 
 #include <cerrno>
+#include <cxxabi.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <climits>
+#include <typeinfo>
 
 #include <config.h>
 #include <kizbox/framework/core/Watcher.h>
 #include <kizbox/framework/core/Log.h>
+#include <kizbox/framework/core/Clock.h>
 #include <kizbox/framework/core/Time.h>
 #include <kizbox/framework/core/Errno.h>
+#include <kizbox/framework/core/Watchdog.h>
 #include "Poller.h"
 
 #define MAX_EVENTS 10
 
+//Poller looping in the calling thread, read by signal handlers
+static __thread Overkiz::Poller *looping = nullptr;
+
 #define PIDDIR "PIDDIR"
 #define BUFFERSIZE 255
 
@@ -22,8 +36,18 @@ namespace Overkiz
 {
 
   Poller::Poller(bool interruptibleTasks, bool usePidFile) :
-    taskManager(nullptr), inter(interruptibleTasks), abort(false)
+    taskManager(nullptr), inter(interruptibleTasks), abort(false), balancer(nullptr), load(0),
+    watchdog(nullptr), dispatching(nullptr), outer(nullptr)
   {
+    registrations.head = nullptr;
+    registrations.tail = nullptr;
+    inbox.fd = -1;
+    urgent.fd = -1;
+    urgent.repoll = false;
+    deferred.head = nullptr;
+    deferred.tail = nullptr;
+    idlers.head = nullptr;
+    idlers.tail = nullptr;
     count = 0;
     state = STOPPED;
     fd = epoll_create1(EPOLL_CLOEXEC);
@@ -37,6 +61,28 @@ namespace Overkiz
       throw e;
     }
 
+    //Tasks and wake ups from other threads, not counted as a watcher
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = &inbox;
+    inbox.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if(inbox.fd == -1 || epoll_ctl(fd, EPOLL_CTL_ADD, inbox.fd, &event) != 0)
+    {
+      Overkiz::Poller::CreationException e;
+      throw e;
+    }
+
+    event.data.ptr = &urgent;
+    urgent.fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if(urgent.fd == -1 || epoll_ctl(fd, EPOLL_CTL_ADD, urgent.fd, &event) != 0)
+    {
+      Overkiz::Poller::CreationException e;
+      throw e;
+    }
+
     if(interruptibleTasks)
     {
       taskManager = new Task::InterruptibleManager();
@@ -57,6 +103,331 @@ namespace Overkiz
     abort = true;
   }
 
+  void Poller::setBudget(const Time::Elapsed& time, size_t iterations)
+  {
+    taskManager->setBudget(time, iterations);
+  }
+
+  void Poller::setRealtime(Thread::Scheduler& scheduler, bool lockMemory)
+  {
+    if(lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+      throw Poller::Exception();
+    }
+
+    int ret = pthread_setschedparam(pthread_self(), scheduler.getPolicy(), &scheduler.getParameters());
+
+    if(ret != 0)
+    {
+      throw Poller::Exception(ret);
+    }
+  }
+
+  void Poller::setRepoll(bool enabled)
+  {
+    urgent.repoll = enabled;
+  }
+
+  void Poller::defer(Callback& callback)
+  {
+    push(deferred, callback);
+  }
+
+  void Poller::idle(Callback& callback)
+  {
+    push(idlers, callback);
+  }
+
+  void Poller::push(Queue& queue, Callback& callback)
+  {
+    if(callback.queue)
+    {
+      return;
+    }
+
+    callback.queue = &queue;
+    callback.next = nullptr;
+
+    if(queue.tail)
+    {
+      queue.tail->next = &callback;
+    }
+    else
+    {
+      queue.head = &callback;
+    }
+
+    queue.tail = &callback;
+  }
+
+  void Poller::flush(Queue& queue)
+  {
+    if(!queue.head)
+      return;
+
+    //Callbacks queued while flushing wait for the next flush
+    Queue batch = queue;
+    queue.head = nullptr;
+    queue.tail = nullptr;
+
+    for(Callback *callback = batch.head; callback; callback = callback->next)
+    {
+      callback->queue = &batch;
+    }
+
+    state = BUSY;
+
+    if(watchdog)
+      watchdog->enter(nullptr);
+
+    while(batch.head)
+    {
+      Callback *callback = batch.head;
+      callback->cancel();
+
+      try
+      {
+        callback->run();
+      }
+      catch(const Overkiz::Exception & e)
+      {
+        OVK_ERROR("Callback throw Overkiz exception: %s", e.getId());
+      }
+      catch(const std::exception & e)
+      {
+        OVK_ERROR("Callback throw Generic exception: %s", e.what());
+      }
+      catch(...)
+      {
+        OVK_ERROR("Callback throw unknown exception");
+        #ifndef HAVE_RELEASE
+
+        //Put the callbacks not run yet back in front of the queue
+        while(batch.tail)
+        {
+          Callback *last = batch.tail;
+          last->cancel();
+          last->queue = &queue;
+          last->next = queue.head;
+          queue.head = last;
+
+          if(!queue.tail)
+          {
+            queue.tail = last;
+          }
+        }
+
+        if(watchdog)
+          watchdog->leave();
+
+        state = WAITING;
+        throw;
+        #endif
+      }
+    }
+
+    if(watchdog)
+      watchdog->leave();
+
+    state = WAITING;
+  }
+
+  void Poller::migrate(Task *task, Poller& target)
+  {
+    if(&target == this)
+    {
+      return;
+    }
+
+    if(!inter || !target.inter || !transfer(task, target))
+    {
+      Overkiz::Poller::MigrationException e;
+      throw e;
+    }
+  }
+
+  bool Poller::transfer(Task *task, Poller& target)
+  {
+    Task::InterruptibleManager *manager = static_cast<Task::InterruptibleManager *>(taskManager);
+    Migration migration;
+    migration.task = task;
+
+    if(!manager->release(task, migration.coroutine, migration.scheduled))
+    {
+      return false;
+    }
+
+    target.inbox.lock.acquire();
+    target.inbox.tasks.push_back(migration);
+    //Shared pointers are not thread safe: drop our reference under the lock
+    migration.coroutine = Shared::Pointer<Task::InterruptibleManager::Coroutine>();
+    target.inbox.lock.release();
+    target.load++;
+
+    uint64_t value = 1;
+
+    if(write(target.inbox.fd, &value, sizeof(value)) < 0)
+    {
+      throw Overkiz::Errno::Exception();
+    }
+
+    return true;
+  }
+
+  void Poller::receive()
+  {
+    uint64_t value;
+
+    if(read(inbox.fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    {
+      throw Overkiz::Errno::Exception();
+    }
+
+    std::vector<Migration> tasks;
+    inbox.lock.acquire();
+    tasks.swap(inbox.tasks);
+    inbox.lock.release();
+
+    for(auto& migration : tasks)
+    {
+      static_cast<Task::InterruptibleManager *>(taskManager)->adopt(migration.task, migration.coroutine, migration.scheduled);
+    }
+
+    //One at a time: a notified coroutine may discard the next waiters
+    inbox.lock.acquire();
+
+    while(!inbox.waiters.empty())
+    {
+      Coroutine::Waiter *waiter = inbox.waiters.front();
+      inbox.waiters.pop_front();
+      inbox.lock.release();
+      waiter->notify(nullptr);
+      inbox.lock.acquire();
+    }
+
+    inbox.lock.release();
+  }
+
+  void Poller::post(Coroutine::Waiter& waiter)
+  {
+    inbox.lock.acquire();
+    inbox.waiters.push_back(&waiter);
+    inbox.lock.release();
+
+    uint64_t value = 1;
+
+    if(write(inbox.fd, &value, sizeof(value)) < 0)
+    {
+      throw Overkiz::Errno::Exception();
+    }
+  }
+
+  void Poller::discard(Coroutine::Waiter& waiter)
+  {
+    inbox.lock.acquire();
+    auto it = std::find(inbox.waiters.begin(), inbox.waiters.end(), &waiter);
+
+    if(it != inbox.waiters.end())
+    {
+      inbox.waiters.erase(it);
+    }
+
+    inbox.lock.release();
+  }
+
+  bool Poller::exists()
+  {
+    return !poller->empty();
+  }
+
+  Poller::Balancer::Balancer(size_t thr) :
+    threshold(thr)
+  {
+  }
+
+  Poller::Balancer::~Balancer()
+  {
+  }
+
+  void Poller::Balancer::join()
+  {
+    Shared::Pointer<Poller>& poller = Poller::get();
+
+    if(!poller->inter)
+    {
+      Overkiz::Poller::MigrationException e;
+      throw e;
+    }
+
+    lock.acquire();
+
+    if(std::find(pollers.begin(), pollers.end(), &*poller) == pollers.end())
+    {
+      pollers.push_back(&*poller);
+    }
+
+    poller->balancer = this;
+    lock.release();
+  }
+
+  void Poller::Balancer::leave()
+  {
+    leave(&*Poller::get());
+  }
+
+  void Poller::Balancer::leave(Poller *poller)
+  {
+    lock.acquire();
+    pollers.erase(std::remove(pollers.begin(), pollers.end(), poller), pollers.end());
+    poller->balancer = nullptr;
+    lock.release();
+  }
+
+  void Poller::Balancer::share(Poller *poller)
+  {
+    Task::InterruptibleManager *manager = static_cast<Task::InterruptibleManager *>(poller->taskManager);
+    size_t length = manager->ready.length;
+    poller->load = length;
+
+    if(length <= threshold)
+    {
+      return;
+    }
+
+    //Keep the lock while moving tasks: a poller can't leave the group meanwhile
+    lock.acquire();
+    Poller *target = nullptr;
+    size_t lowest = length;
+
+    for(auto other : pollers)
+    {
+      size_t otherLoad = other->load;
+
+      if(other != poller && otherLoad < lowest)
+      {
+        lowest = otherLoad;
+        target = other;
+      }
+    }
+
+    if(target && length > lowest + threshold)
+    {
+      Task *task;
+
+      for(size_t moves = (length - lowest) / 2; moves && (task = manager->migratable()); moves--)
+      {
+        if(!poller->transfer(task, *target))
+        {
+          break;
+        }
+      }
+
+      poller->load = manager->ready.length;
+    }
+
+    lock.release();
+  }
+
   void Poller::addListener(Listener * list)
   {
     eventListeners.insert(list);
@@ -69,6 +440,52 @@ namespace Overkiz
 
   Poller::~Poller()
   {
+    if(balancer)
+    {
+      balancer->leave(this);
+    }
+
+    if(watchdog)
+    {
+      watchdog->poller = nullptr;
+    }
+
+    while(deferred.head)
+    {
+      deferred.head->cancel();
+    }
+
+    while(idlers.head)
+    {
+      idlers.head->cancel();
+    }
+
+    if(looping == this)
+    {
+      looping = nullptr;
+    }
+
+    registrations.lock.acquire();
+
+    for(Watcher *watcher = registrations.head; watcher; watcher = watcher->next)
+    {
+      watcher->registry = nullptr;
+    }
+
+    registrations.head = nullptr;
+    registrations.tail = nullptr;
+    registrations.lock.release();
+
+    if(inbox.fd != -1)
+    {
+      close(inbox.fd);
+    }
+
+    if(urgent.fd != -1)
+    {
+      close(urgent.fd);
+    }
+
     if(fd != -1)
     {
       close(fd);
@@ -84,7 +501,7 @@ namespace Overkiz
     event.events = watcher->events;
     event.data.ptr = watcher;
 
-    if(epoll_ctl(fd, EPOLL_CTL_ADD, watcher->fd, &event) != 0)
+    if(epoll_ctl(watcher->priority > 0 ? urgent.fd : fd, EPOLL_CTL_ADD, watcher->fd, &event) != 0)
     {
       if(errno == EEXIST)
       {
@@ -99,6 +516,7 @@ namespace Overkiz
     else
     {
       count++;
+      watcher->polled = true;
     }
   }
 
@@ -109,7 +527,7 @@ namespace Overkiz
     event.events = events;
     event.data.ptr = watcher;
 
-    if(epoll_ctl(fd, EPOLL_CTL_MOD, watcher->fd, &event) == -1)
+    if(epoll_ctl(watcher->priority > 0 ? urgent.fd : fd, EPOLL_CTL_MOD, watcher->fd, &event) == -1)
     {
       if(errno == ENOENT)
       {
@@ -131,7 +549,7 @@ namespace Overkiz
     event.events = 0;
     event.data.ptr = watcher;
 
-    if(epoll_ctl(fd, EPOLL_CTL_DEL, watcher->fd, &event) != 0)
+    if(epoll_ctl(watcher->priority > 0 ? urgent.fd : fd, EPOLL_CTL_DEL, watcher->fd, &event) != 0)
     {
       if(errno != ENOENT)
       {
@@ -143,6 +561,56 @@ namespace Overkiz
     {
       count--;
     }
+
+    watcher->polled = false;
+  }
+
+  void Poller::track(Watcher *watcher)
+  {
+    registrations.lock.acquire();
+    watcher->registry = this;
+    watcher->prev = registrations.tail;
+    watcher->next = nullptr;
+
+    if(registrations.tail)
+    {
+      registrations.tail->next = watcher;
+    }
+    else
+    {
+      registrations.head = watcher;
+    }
+
+    registrations.tail = watcher;
+    registrations.lock.release();
+  }
+
+  void Poller::untrack(Watcher *watcher)
+  {
+    registrations.lock.acquire();
+
+    if(watcher->prev)
+    {
+      watcher->prev->next = watcher->next;
+    }
+    else
+    {
+      registrations.head = watcher->next;
+    }
+
+    if(watcher->next)
+    {
+      watcher->next->prev = watcher->prev;
+    }
+    else
+    {
+      registrations.tail = watcher->prev;
+    }
+
+    watcher->registry = nullptr;
+    watcher->prev = nullptr;
+    watcher->next = nullptr;
+    registrations.lock.release();
   }
 
   void Poller::resume(Task *task)
@@ -163,6 +631,101 @@ namespace Overkiz
   }
 
   void Poller::loop(bool daemonize)
+  {
+    begin();
+
+    try
+    {
+      run(daemonize);
+
+      while(active() && !abort)
+      {
+        iterate(-1);
+
+        if(!count && !taskManager->pending())
+          OVK_NOTICE("Any fd to watch. Exit poll loop.");
+      }
+    }
+    catch(...)
+    {
+      finish();
+      throw;
+    }
+
+    finish();
+  }
+
+  bool Poller::runOnce(const Time::Elapsed& timeout)
+  {
+    begin();
+    bool handled;
+
+    try
+    {
+      handled = iterate(milliseconds(timeout));
+    }
+    catch(...)
+    {
+      finish();
+      throw;
+    }
+
+    finish();
+    return handled;
+  }
+
+  void Poller::runFor(const Time::Elapsed& duration)
+  {
+    Time::Monotonic end = Time::Monotonic::now() + duration;
+    begin();
+
+    try
+    {
+      while(active() && !abort)
+      {
+        Time::Monotonic now = Time::Monotonic::now();
+
+        if(!(now < end))
+          break;
+
+        iterate(milliseconds(end - now));
+      }
+    }
+    catch(...)
+    {
+      finish();
+      throw;
+    }
+
+    finish();
+  }
+
+  void Poller::runUntil(const std::function<bool()>& predicate)
+  {
+    begin();
+
+    try
+    {
+      while(!predicate() && active() && !abort)
+      {
+        iterate(-1);
+      }
+    }
+    catch(...)
+    {
+      finish();
+      throw;
+    }
+
+    finish();
+  }
+
+  int Poller::getFd() const
+  {
+    return fd;
+  }
+
+  void Poller::begin()
   {
     if(state != STOPPED)
     {
@@ -170,93 +733,391 @@ namespace Overkiz
       throw e;
     }
 
-    struct epoll_event events[MAX_EVENTS];
-
     state = WAITING;
+    outer = looping;
+    looping = this;
 
     abort = false;
+  }
 
-    run(daemonize);
+  void Poller::finish()
+  {
+    looping = outer;
+    state = STOPPED;
+
+    //The iteration of an outer loop has lasted as long as this loop
+    if(outer)
+      Time::Clock::tick();
+    else
+      Time::Clock::release();
 
-    while(count && !abort)
+    //Make the epoll fd readable for an outer loop while some work is queued
+    if(taskManager->pending() || deferred.head || idlers.head)
     {
-      int ret = 0;
-      ret = epoll_wait(fd, events, MAX_EVENTS, -1);
+      uint64_t value = 1;
+
+      if(write(inbox.fd, &value, sizeof(value)) < 0)
+      {
+        OVK_ERROR("Couldn't wake up the poller.");
+      }
+    }
+  }
 
-      if(ret == 0)  //Epoll timeout
+  bool Poller::active() const
+  {
+    return count || taskManager->pending() || deferred.head || idlers.head;
+  }
+
+  bool Poller::iterate(int timeout)
+  {
+    struct epoll_event events[MAX_EVENTS];
+    int ret = 0;
+    bool busy = taskManager->pending() || deferred.head;
+    bool handled = busy || idlers.head;
+    //Do not block while some tasks or callbacks are queued
+    ret = epoll_wait(fd, events, MAX_EVENTS, handled ? 0 : timeout);
+    Time::Clock::tick();
+
+    if(ret == 0)  //Epoll timeout
+    {
+      if(!busy)
+        flush(idlers);
+
+      dispatch();
+      flush(deferred);
+
+      if(balancer)
+        balancer->share(this);
+
+      return handled;
+    }
+    else if(ret < 0)    //Error occurs
+    {
+      if(errno==EINTR)
+      {
+        OVK_ERROR("Poller interrupted (errno=%d)",errno);
+      }
+      else
+      {
+        OVK_ERROR("Poller exiting (errno=%d)",errno);
+        throw Overkiz::Errno::Exception();
+      }
+    }
+
+    sort(events, ret);
+
+    for(int i = 0; i < ret; i++)
+    {
+      if(events[i].data.ptr == &inbox)
       {
-        //nothing to do
+        receive();
         continue;
       }
-      else if(ret < 0)    //Error occurs
+
+      if(events[i].data.ptr == &urgent)
       {
-        if(errno==EINTR)
-        {
-          OVK_ERROR("Poller interrupted (errno=%d)",errno);
-        }
-        else
-        {
-          OVK_ERROR("Poller exiting (errno=%d)",errno);
-          throw Overkiz::Errno::Exception();
-        }
+        expedite();
+        continue;
       }
 
-      for(int i = 0; i < ret; i++)
+      Watcher *watcher = static_cast<Watcher *>(events[i].data.ptr);
+
+      if(urgent.repoll && watcher->priority <= 0)
       {
-        state = BUSY;
-        Watcher *watcher = static_cast<Watcher *>(events[i].data.ptr);
-        watcher->current = events[i].events;
+        expedite();
+      }
 
-        try
-        {
-          #ifndef HAVE_RELEASE
-          Time::Monotonic t1 = Time::Monotonic::now();
-          #endif
-          resume(watcher);
-          #ifndef HAVE_RELEASE
-          Time::Elapsed delta = (Time::Elapsed)(Time::Monotonic::now() - t1);
-
-          if(delta.seconds > 2)
-          {
-            OVK_WARNING("--------task <%p> has spent %li seconds and %li nanoseconds !!",watcher, delta.seconds, delta.nanoseconds);
-          }
+      process(watcher, events[i].events);
+    }
 
-          #endif
-        }
-        catch(const Overkiz::Exception & e)
-        {
-          OVK_ERROR("Task throw Overkiz exception: %s", e.getId());
-          reset(watcher);
+    dispatch();
+    flush(deferred);
 
-          //Check for Unrecoverable exceptions
-          if(strcmp(Coroutine::Exception().getId(), e.getId()) == 0)
-          {
-            OVK_CRITICAL("Unrecoverable exception.");
-            throw;
-          }
-        }
-        catch(const std::exception & e)
-        {
-          OVK_ERROR("Task throw Generic exception: %s", e.what());
-          reset(watcher);
-        }
-        catch(...)
+    if(balancer)
+      balancer->share(this);
+
+    return ret > 0 || busy;
+  }
+
+  int Poller::milliseconds(const Time::Elapsed& time)
+  {
+    if(time.seconds < 0 || (time.seconds == 0 && time.nanoseconds <= 0))
+    {
+      return 0;
+    }
+
+    if(time.seconds >= INT_MAX / 1000 - 1)
+    {
+      return INT_MAX;
+    }
+
+    //Round up, a short wait must not become a busy loop
+    return (int) time.seconds * 1000 + (int) ((time.nanoseconds + 999999) / 1000000);
+  }
+
+  void Poller::process(Watcher *watcher, uint32_t events)
+  {
+    state = BUSY;
+    watcher->current = events;
+
+    if(watchdog)
+      watchdog->enter(watcher);
+
+    watcher->statistics.dispatches++;
+    Watcher *outerWatcher = dispatching;
+    dispatching = watcher;
+    Time::Monotonic t1 = Time::Monotonic::fast();
+
+    try
+    {
+      resume(watcher);
+      Time::Elapsed delta = (Time::Elapsed)(Time::Monotonic::fast() - t1);
+
+      //The watcher may have been destroyed by its task
+      if(dispatching == watcher)
+      {
+        Time::Elapsed& time = watcher->statistics.time;
+        time.seconds += delta.seconds;
+        time.nanoseconds += delta.nanoseconds;
+
+        if(time.nanoseconds >= 1000000000)
         {
-          OVK_ERROR("Task throw unknown exception");
-          reset(watcher);
-          #ifndef HAVE_RELEASE
-          throw;
-          #endif
+          time.seconds++;
+          time.nanoseconds -= 1000000000;
         }
+      }
+      #ifndef HAVE_RELEASE
 
-        state = WAITING;
+      if(delta.seconds > 2)
+      {
+        OVK_WARNING("--------task <%p> has spent %li seconds and %li nanoseconds !!",watcher, delta.seconds, delta.nanoseconds);
       }
 
-      if(!count)
-        OVK_NOTICE("Any fd to watch. Exit poll loop.");
+      #endif
     }
+    catch(const Overkiz::Exception & e)
+    {
+      OVK_ERROR("Task throw Overkiz exception: %s", e.getId());
+      reset(watcher);
 
-    state = STOPPED;
+      //Check for Unrecoverable exceptions
+      if(strcmp(Coroutine::Exception().getId(), e.getId()) == 0)
+      {
+        OVK_CRITICAL("Unrecoverable exception.");
+        throw;
+      }
+    }
+    catch(const std::exception & e)
+    {
+      OVK_ERROR("Task throw Generic exception: %s", e.what());
+      reset(watcher);
+    }
+    catch(...)
+    {
+      OVK_ERROR("Task throw unknown exception");
+      reset(watcher);
+      #ifndef HAVE_RELEASE
+      throw;
+      #endif
+    }
+
+    dispatching = outerWatcher;
+
+    if(watchdog)
+      watchdog->leave();
+
+    state = WAITING;
+  }
+
+  void Poller::expedite()
+  {
+    struct epoll_event events[MAX_EVENTS];
+    int ret = epoll_wait(urgent.fd, events, MAX_EVENTS, 0);
+    Time::Clock::tick();
+
+    if(ret <= 0)
+    {
+      return;
+    }
+
+    sort(events, ret);
+
+    for(int i = 0; i < ret; i++)
+    {
+      process(static_cast<Watcher *>(events[i].data.ptr), events[i].events);
+    }
+  }
+
+  std::vector<Poller::Registration> Poller::snapshot()
+  {
+    std::vector<Registration> list;
+    registrations.lock.acquire();
+
+    for(Watcher *watcher = registrations.head; watcher; watcher = watcher->next)
+    {
+      Registration registration;
+      int status = -1;
+      const char *name = typeid(*watcher).name();
+      char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+      registration.watcher = watcher;
+      registration.type = status == 0 ? demangled : name;
+      free(demangled);
+      registration.fd = watcher->fd;
+      registration.events = watcher->events;
+      registration.priority = watcher->priority;
+      registration.status = watcher->status();
+      registration.polled = watcher->polled;
+      registration.stackSize = watcher->getStackSize();
+      registration.clients = watcher->clients();
+      registration.dispatches = watcher->statistics.dispatches;
+      registration.time = watcher->statistics.time;
+      list.push_back(registration);
+    }
+
+    registrations.lock.release();
+    return list;
+  }
+
+  void Poller::dump(FILE *file)
+  {
+    std::vector<Registration> registrations = snapshot();
+
+    for(auto& registration : registrations)
+    {
+      fprintf(file, "%s\n", registration.toString().c_str());
+    }
+  }
+
+  std::string Poller::Registration::toString() const
+  {
+    static const char *states[] = { "idle", "running", "paused" };
+    char line[512];
+    snprintf(line, sizeof(line),
+             "%s <%p> fd=%d events=0x%x priority=%d status=%s polled=%s stack=%zu clients=%zu dispatches=%zu time=%li.%09li",
+             type.c_str(), watcher, fd, events, priority, states[status], polled ? "yes" : "no", stackSize, clients, dispatches,
+             (long) time.seconds, time.nanoseconds);
+    return line;
+  }
+
+  int Poller::rank(const struct epoll_event& event) const
+  {
+    if(event.data.ptr == &inbox || event.data.ptr == &urgent)
+    {
+      return INT_MAX;
+    }
+
+    return static_cast<Watcher *>(event.data.ptr)->priority;
+  }
+
+  void Poller::sort(struct epoll_event *events, int size)
+  {
+    //Few events per batch: a stable insertion sort
+    for(int i = 1; i < size; i++)
+    {
+      struct epoll_event event = events[i];
+      int priority = rank(event);
+      int j = i;
+
+      while(j > 0 && rank(events[j - 1]) < priority)
+      {
+        events[j] = events[j - 1];
+        j--;
+      }
+
+      events[j] = event;
+    }
+  }
+
+  Task *Poller::interrupted()
+  {
+    Poller *current = looping;
+    return current && current->taskManager ? current->taskManager->current() : nullptr;
+  }
+
+  void Poller::dispatch()
+  {
+    if(!taskManager->pending())
+      return;
+
+    state = BUSY;
+
+    if(watchdog)
+      watchdog->enter(nullptr);
+
+    try
+    {
+      taskManager->dispatch();
+    }
+    catch(const Overkiz::Exception & e)
+    {
+      OVK_ERROR("Scheduled task throw Overkiz exception: %s", e.getId());
+
+      //Check for Unrecoverable exceptions
+      if(strcmp(Coroutine::Exception().getId(), e.getId()) == 0)
+      {
+        OVK_CRITICAL("Unrecoverable exception.");
+        throw;
+      }
+    }
+    catch(const std::exception & e)
+    {
+      OVK_ERROR("Scheduled task throw Generic exception: %s", e.what());
+    }
+    catch(...)
+    {
+      OVK_ERROR("Scheduled task throw unknown exception");
+      #ifndef HAVE_RELEASE
+      throw;
+      #endif
+    }
+
+    if(watchdog)
+      watchdog->leave();
+
+    state = WAITING;
+  }
+
+  Poller::Callback::Callback() :
+    queue(nullptr), next(nullptr)
+  {
+  }
+
+  Poller::Callback::~Callback()
+  {
+    cancel();
+  }
+
+  void Poller::Callback::cancel()
+  {
+    if(!queue)
+      return;
+
+    Callback **it = &queue->head;
+    Callback *prev = nullptr;
+
+    while(*it && *it != this)
+    {
+      prev = *it;
+      it = &(*it)->next;
+    }
+
+    if(*it)
+    {
+      *it = next;
+    }
+
+    if(queue->tail == this)
+    {
+      queue->tail = prev;
+    }
+
+    queue = nullptr;
+    next = nullptr;
+  }
+
+  bool Poller::Callback::isQueued() const
+  {
+    return queue != nullptr;
   }
 
   Shared::Pointer<Poller>& Poller::get(bool interruptibleTasks, bool usePidFile, bool forcedNew)
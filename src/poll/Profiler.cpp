@@ -0,0 +1,307 @@
+/*
+ * Profiler.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <typeinfo>
+
+#include <kizbox/framework/core/Errno.h>
+#include <kizbox/framework/core/Poller.h>
+#include "Profiler.h"
+
+#define ALT_STACK_SIZE (64 * 1024)
+
+//Frames of the signal handler and of the signal trampoline
+#define HANDLER_FRAMES 2
+
+namespace Overkiz
+{
+
+  std::atomic<Profiler *> Profiler::active(nullptr);
+
+  std::atomic<int> Profiler::handlers(0);
+
+  Profiler::Profiler(unsigned samplingFrequency, size_t bufferCapacity) :
+    capacity(bufferCapacity), frequency(samplingFrequency ? samplingFrequency : 1),
+    next(0), lost(0), running(false)
+  {
+    buffer = new Sample[capacity];
+
+    for(size_t i = 0; i < capacity; i++)
+    {
+      buffer[i].ready = false;
+    }
+  }
+
+  Profiler::~Profiler()
+  {
+    stop();
+    delete[] buffer;
+  }
+
+  void Profiler::start()
+  {
+    if(running)
+    {
+      return;
+    }
+
+    Profiler *expected = nullptr;
+
+    if(!active.compare_exchange_strong(expected, this))
+    {
+      Overkiz::Profiler::Exception e;
+      throw e;
+    }
+
+    //The first backtrace loads the unwinder, it must not happen in the handler
+    void *frame;
+    backtrace(&frame, 1);
+    attach();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &Profiler::sample;
+    action.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / frequency;
+
+    if(!timer.it_interval.tv_usec)
+    {
+      timer.it_interval.tv_usec = 1;
+    }
+
+    timer.it_value = timer.it_interval;
+
+    if(sigaction(SIGPROF, &action, &previous) != 0)
+    {
+      active = nullptr;
+      throw Overkiz::Errno::Exception();
+    }
+
+    if(setitimer(ITIMER_PROF, &timer, nullptr) != 0)
+    {
+      int error = errno;
+      sigaction(SIGPROF, &previous, nullptr);
+      active = nullptr;
+      throw Overkiz::Errno::Exception(error);
+    }
+
+    running = true;
+  }
+
+  void Profiler::stop()
+  {
+    if(!running)
+    {
+      return;
+    }
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    active = nullptr;
+
+    //A pending SIGPROF must not reach the default action, which terminates the process
+    struct sigaction ignore;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGPROF, &ignore, nullptr);
+    sigaction(SIGPROF, &previous, nullptr);
+
+    //A handler of another thread may still write into the buffer
+    while(handlers.load() != 0)
+    {
+      sched_yield();
+    }
+
+    running = false;
+  }
+
+  void Profiler::clear()
+  {
+    size_t count = std::min(next.load(), capacity);
+
+    for(size_t i = 0; i < count; i++)
+    {
+      buffer[i].ready = false;
+    }
+
+    next = 0;
+    lost = 0;
+  }
+
+  size_t Profiler::samples() const
+  {
+    return std::min(next.load(), capacity);
+  }
+
+  size_t Profiler::dropped() const
+  {
+    return lost;
+  }
+
+  std::map<std::string, size_t> Profiler::types() const
+  {
+    std::map<std::string, size_t> counts;
+    size_t count = samples();
+
+    for(size_t i = 0; i < count; i++)
+    {
+      if(buffer[i].ready.load(std::memory_order_acquire))
+      {
+        counts[name(buffer[i].type)]++;
+      }
+    }
+
+    return counts;
+  }
+
+  void Profiler::write(FILE *file) const
+  {
+    std::map<std::string, size_t> stacks = fold();
+
+    for(auto& stack : stacks)
+    {
+      fprintf(file, "%s %zu\n", stack.first.c_str(), stack.second);
+    }
+  }
+
+  void Profiler::attach()
+  {
+    static __thread void *altStack = nullptr;
+    stack_t stack;
+
+    if(altStack || sigaltstack(nullptr, &stack) != 0 || !(stack.ss_flags & SS_DISABLE))
+    {
+      return;
+    }
+
+    //Kept until the thread exits, the handler may still run on it
+    altStack = malloc(ALT_STACK_SIZE);
+
+    if(!altStack)
+    {
+      return;
+    }
+
+    stack.ss_sp = altStack;
+    stack.ss_size = ALT_STACK_SIZE;
+    stack.ss_flags = 0;
+    sigaltstack(&stack, nullptr);
+  }
+
+  std::map<std::string, size_t> Profiler::fold() const
+  {
+    std::map<std::string, size_t> stacks;
+    std::map<void *, std::string> symbols;
+    size_t count = samples();
+
+    for(size_t i = 0; i < count; i++)
+    {
+      const Sample& sample = buffer[i];
+
+      if(!sample.ready.load(std::memory_order_acquire))
+      {
+        continue;
+      }
+
+      std::string stack = name(sample.type);
+
+      //Outermost frame first
+      for(int j = sample.depth - 1; j >= HANDLER_FRAMES; j--)
+      {
+        auto it = symbols.find(sample.frames[j]);
+
+        if(it == symbols.end())
+        {
+          //A return address may be the first byte of the next function
+          void *address = (char *) sample.frames[j] - 1;
+          Dl_info info;
+          std::string symbol;
+          char buf[32];
+
+          if(dladdr(address, &info) && info.dli_sname)
+          {
+            int status = -1;
+            char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            symbol = status == 0 ? demangled : info.dli_sname;
+            free(demangled);
+          }
+          else
+          {
+            snprintf(buf, sizeof(buf), "%p", sample.frames[j]);
+            symbol = buf;
+          }
+
+          //';' separates the frames of a folded stack
+          std::replace(symbol.begin(), symbol.end(), ';', ':');
+          it = symbols.insert(std::make_pair(sample.frames[j], symbol)).first;
+        }
+
+        stack += ";" + it->second;
+      }
+
+      stacks[stack]++;
+    }
+
+    return stacks;
+  }
+
+  void Profiler::sample(int sig, siginfo_t *info, void *context)
+  {
+    int error = errno;
+    //Counted before reading the profiler, stop() waits for it
+    handlers++;
+    Profiler *profiler = active.load();
+
+    if(profiler)
+    {
+      size_t index = profiler->next.fetch_add(1, std::memory_order_relaxed);
+
+      if(index < profiler->capacity)
+      {
+        Sample& sample = profiler->buffer[index];
+        Task *task = Poller::interrupted();
+        sample.type = task ? typeid(*task).name() : nullptr;
+        sample.depth = backtrace(sample.frames, DEPTH);
+        sample.ready.store(true, std::memory_order_release);
+      }
+      else
+      {
+        profiler->lost++;
+      }
+    }
+
+    handlers--;
+    errno = error;
+  }
+
+  std::string Profiler::name(const char *type)
+  {
+    if(!type)
+    {
+      return "[none]";
+    }
+
+    int status = -1;
+    char *demangled = abi::__cxa_demangle(type, nullptr, nullptr, &status);
+    std::string result = status == 0 ? demangled : type;
+    free(demangled);
+    return result;
+  }
+
+}
@@ -71,6 +71,18 @@ namespace Overkiz
     return *manager;
   }
 
+  size_t Signal::Manager::clients() const
+  {
+    size_t count = 0;
+
+    for(auto& handler : handlers)
+    {
+      count += handler.second.size();
+    }
+
+    return count;
+  }
+
   void Signal::Manager::process(uint32_t evts)
   {
     Signal signal;
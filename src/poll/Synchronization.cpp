@@ -0,0 +1,335 @@
+/*
+ * Synchronization.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <kizbox/framework/core/Log.h>
+#include <kizbox/framework/core/Poller.h>
+#include "Synchronization.h"
+
+namespace Overkiz
+{
+
+  Coroutine::Synchronizer::Node::Node(Synchronizer& nodeOwner, Waiter& nodeWaiter) :
+    owner(&nodeOwner), waiter(&nodeWaiter), poller(nullptr), thread(pthread_self()),
+    prev(nullptr), next(nullptr), queued(false), waiting(false)
+  {
+    if(Poller::exists())
+    {
+      poller = &*Poller::get();
+    }
+  }
+
+  Coroutine::Synchronizer::Node::~Node()
+  {
+    if(!waiting)
+    {
+      return;
+    }
+
+    //The coroutine is unwound (cancelled or deadline reached) while waiting
+    owner->guard.acquire();
+    bool granted = !queued;
+
+    if(queued)
+    {
+      owner->unlink(*this);
+    }
+    else if(poller)
+    {
+      //Woken by another thread, the waiter may still be in the inbox
+      poller->discard(*waiter);
+    }
+
+    owner->guard.release();
+
+    if(granted)
+    {
+      owner->handOver();
+    }
+  }
+
+  Coroutine::Synchronizer::Synchronizer() :
+    head(nullptr), tail(nullptr)
+  {
+  }
+
+  Coroutine::Synchronizer::~Synchronizer()
+  {
+    if(head)
+    {
+      OVK_ERROR("Synchronization primitive destroyed while coroutines are waiting.");
+    }
+  }
+
+  void Coroutine::Synchronizer::push(Node& node)
+  {
+    node.prev = tail;
+    node.next = nullptr;
+    node.queued = true;
+    node.waiting = true;
+
+    if(tail)
+    {
+      tail->next = &node;
+    }
+    else
+    {
+      head = &node;
+    }
+
+    tail = &node;
+  }
+
+  void Coroutine::Synchronizer::unlink(Node& node)
+  {
+    if(node.prev)
+    {
+      node.prev->next = node.next;
+    }
+    else
+    {
+      head = node.next;
+    }
+
+    if(node.next)
+    {
+      node.next->prev = node.prev;
+    }
+    else
+    {
+      tail = node.prev;
+    }
+
+    node.prev = nullptr;
+    node.next = nullptr;
+    node.queued = false;
+  }
+
+  bool Coroutine::Synchronizer::pop(Waiter *& local)
+  {
+    Node *node = head;
+    local = nullptr;
+
+    if(!node)
+    {
+      return false;
+    }
+
+    unlink(*node);
+
+    if(pthread_equal(node->thread, pthread_self()))
+    {
+      //Nothing else runs in this thread until the waiter is woken
+      local = node->waiter;
+    }
+    else if(node->poller)
+    {
+      //Under the guard: the node can't be destroyed before being posted
+      node->poller->post(*node->waiter);
+    }
+    else
+    {
+      OVK_ERROR("Coroutine waiting in a thread without poller. Couldn't wake.");
+    }
+
+    return true;
+  }
+
+  void Coroutine::Synchronizer::suspend(Node& node)
+  {
+    node.waiter->suspend();
+    node.waiting = false;
+  }
+
+  void Coroutine::Synchronizer::wake(Waiter *local)
+  {
+    if(local)
+    {
+      local->notify(nullptr);
+    }
+  }
+
+  Coroutine::Mutex::Mutex() :
+    locked(false)
+  {
+  }
+
+  Coroutine::Mutex::~Mutex()
+  {
+  }
+
+  void Coroutine::Mutex::lock()
+  {
+    if(tryLock())
+    {
+      return;
+    }
+
+    Waiter waiter;
+    Node node(*this, waiter);
+    guard.acquire();
+
+    if(!locked)
+    {
+      locked = true;
+      guard.release();
+      return;
+    }
+
+    push(node);
+    guard.release();
+    //The mutex is handed over by unlock
+    suspend(node);
+  }
+
+  bool Coroutine::Mutex::tryLock()
+  {
+    guard.acquire();
+    bool acquired = !locked;
+    locked = true;
+    guard.release();
+    return acquired;
+  }
+
+  void Coroutine::Mutex::unlock()
+  {
+    Waiter *local;
+    guard.acquire();
+
+    if(!pop(local))
+    {
+      locked = false;
+      guard.release();
+      return;
+    }
+
+    guard.release();
+    wake(local);
+  }
+
+  void Coroutine::Mutex::handOver()
+  {
+    unlock();
+  }
+
+  Coroutine::Condition::Condition()
+  {
+  }
+
+  Coroutine::Condition::~Condition()
+  {
+  }
+
+  void Coroutine::Condition::wait(Mutex& mutex)
+  {
+    Waiter waiter;
+    Node node(*this, waiter);
+    guard.acquire();
+    push(node);
+    guard.release();
+    mutex.unlock();
+    suspend(node);
+    mutex.lock();
+  }
+
+  bool Coroutine::Condition::notify()
+  {
+    Waiter *local;
+    guard.acquire();
+    bool found = pop(local);
+    guard.release();
+    wake(local);
+    return found;
+  }
+
+  void Coroutine::Condition::notifyAll()
+  {
+    while(notify())
+    {
+    }
+  }
+
+  void Coroutine::Condition::handOver()
+  {
+    notify();
+  }
+
+  Coroutine::Semaphore::Semaphore(size_t initial) :
+    count(initial)
+  {
+  }
+
+  Coroutine::Semaphore::~Semaphore()
+  {
+  }
+
+  void Coroutine::Semaphore::acquire()
+  {
+    if(tryAcquire())
+    {
+      return;
+    }
+
+    Waiter waiter;
+    Node node(*this, waiter);
+    guard.acquire();
+
+    if(count)
+    {
+      count--;
+      guard.release();
+      return;
+    }
+
+    push(node);
+    guard.release();
+    //The unit is handed over by release
+    suspend(node);
+  }
+
+  bool Coroutine::Semaphore::tryAcquire()
+  {
+    guard.acquire();
+    bool acquired = count > 0;
+
+    if(acquired)
+    {
+      count--;
+    }
+
+    guard.release();
+    return acquired;
+  }
+
+  void Coroutine::Semaphore::release()
+  {
+    Waiter *local;
+    guard.acquire();
+
+    if(!pop(local))
+    {
+      count++;
+      guard.release();
+      return;
+    }
+
+    guard.release();
+    wake(local);
+  }
+
+  void Coroutine::Semaphore::handOver()
+  {
+    release();
+  }
+
+  size_t Coroutine::Semaphore::value()
+  {
+    guard.acquire();
+    size_t current = count;
+    guard.release();
+    return current;
+  }
+
+}
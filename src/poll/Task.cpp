@@ -6,6 +6,8 @@
 
 #include <unistd.h>
 
+#include <kizbox/framework/core/Log.h>
+#include <kizbox/framework/core/Timer.h>
 #include "Task.h"
 
 namespace Overkiz
@@ -15,13 +17,29 @@ namespace Overkiz
   {
     manager = nullptr;
     stackSize = getpagesize();
+    realtime = false;
+    locked = false;
     enabled = 0;
     state = Status::IDLE;
+    scheduled = false;
+    movable = false;
+    next = nullptr;
+    cancelling = false;
+    limited = false;
+    watched = false;
   }
 
   Task::~Task()
   {
-    if(manager && state == Task::Status::RUNNING)
+    //A paused task may wait in queues which would wake its coroutine later
+    if(manager && state == Task::Status::PAUSED)
+      manager->unwind(this);
+
+    if(manager && watched)
+      manager->unwatch(this);
+
+    //An idle real-time task keeps its coroutine
+    if(manager && (state == Task::Status::RUNNING || scheduled || realtime))
       manager->remove(this);
   }
 
@@ -35,6 +53,27 @@ namespace Overkiz
     return stackSize;
   }
 
+  void Task::setRealtime(bool enabled, bool lock)
+  {
+    realtime = enabled;
+    locked = enabled && lock;
+  }
+
+  bool Task::isRealtime() const
+  {
+    return realtime;
+  }
+
+  unsigned Task::stackOptions() const
+  {
+    if(!realtime)
+    {
+      return 0;
+    }
+
+    return Coroutine::PREFAULTED | (locked ? Coroutine::LOCKED : 0);
+  }
+
   Task::Status Task::status()
   {
     return state;
@@ -55,8 +94,87 @@ namespace Overkiz
     return enabled;
   }
 
+  void Task::setMigratable(bool allowed)
+  {
+    movable = allowed;
+  }
+
+  bool Task::isMigratable() const
+  {
+    return movable;
+  }
+
+  bool Task::cancel()
+  {
+    if(!manager || state == Status::IDLE)
+    {
+      return false;
+    }
+
+    return manager->cancel(this);
+  }
+
+  bool Task::isCancelled() const
+  {
+    return cancelling;
+  }
+
+  void Task::setDeadline(const Time::Monotonic& time)
+  {
+    if(manager && watched)
+    {
+      manager->unwatch(this);
+    }
+
+    deadline = time;
+    limited = true;
+
+    if(manager && state != Status::IDLE)
+    {
+      manager->watch(this);
+    }
+  }
+
+  void Task::clearDeadline()
+  {
+    if(manager && watched)
+    {
+      manager->unwatch(this);
+    }
+
+    limited = false;
+  }
+
+  bool Task::hasDeadline() const
+  {
+    return limited;
+  }
+
+  class Task::InterruptibleManager::Deadline: public Timer::Monotonic
+  {
+  public:
+
+    Deadline(InterruptibleManager *mgr) :
+      manager(mgr)
+    {
+    }
+
+    virtual ~Deadline()
+    {
+    }
+
+  private:
+
+    void expired(const Time::Monotonic& time)
+    {
+      manager->expire();
+    }
+
+    InterruptibleManager *manager;
+  };
+
   Task::SimpleManager::SimpleManager() :
-    isRemoved(false), current(nullptr)
+    isRemoved(false), running(nullptr)
   {
   }
 
@@ -71,10 +189,10 @@ namespace Overkiz
       task->manager = this;
       task->state = Task::Status::RUNNING;
       isRemoved = false;
-      Task * prev = current;
-      current = task;
+      Task * prev = running;
+      running = task;
       task->entry();
-      current = prev;
+      running = prev;
 
       if(!isRemoved)
       {
@@ -94,17 +212,29 @@ namespace Overkiz
   void Task::SimpleManager::remove(Task *task)
   {
     //Check if this task is the current task
-    if(current == task)
+    if(running == task)
       isRemoved = true;
   }
 
+  Task *Task::SimpleManager::current() const
+  {
+    return running;
+  }
+
   Task::InterruptibleManager::InterruptibleManager() :
-    isRemoved(false), currentTask(nullptr)
+    timer(nullptr), isRemoved(false), currentTask(nullptr)
   {
+    ready.head = nullptr;
+    ready.tail = nullptr;
+    ready.last = nullptr;
+    ready.length = 0;
+    budget.iterations = 0;
+    slice.iterations = 0;
   }
 
   Task::InterruptibleManager::~InterruptibleManager()
   {
+    delete timer;
   }
 
   void Task::InterruptibleManager::resume(Task *task)
@@ -113,45 +243,277 @@ namespace Overkiz
     {
       Shared::Pointer<Coroutine> * current = &coroutines[task];
 
-      if(current->empty() || (*current)->stackSize() < task->stackSize)
+      if(current->empty() || (*current)->stackSize() < task->stackSize
+         || ((*current)->status() == Coroutine::Status::STOPPED
+             && (*current)->stackOptions() != task->stackOptions()))
       {
-        (*current) = Shared::Pointer<Coroutine>::create(task->stackSize);
+        (*current) = create(task);
       }
 
-      (*current)->task = task;
-      task->manager = this;
-      isRemoved = false;
-      Task * prev = currentTask;
-      currentTask = task;
+      run(task, current);
+    }
+  }
+
+  void Task::InterruptibleManager::run(Task *task, Shared::Pointer<Coroutine> *current)
+  {
+    (*current)->task = task;
+    (*current)->manager = this;
+    task->manager = this;
+
+    if(task->limited && !task->watched)
+    {
+      watch(task);
+    }
+
+    isRemoved = false;
+    Task * prev = currentTask;
+    currentTask = task;
+    //Each resume starts a new budget, the slice of a nested resume is restored
+    auto prevSlice = slice;
+    slice.iterations = 0;
+
+    if(budget.time.seconds || budget.time.nanoseconds)
+    {
+      slice.start = Time::Monotonic::fast();
+    }
+
+    try
+    {
       Coroutine::resume((*current));
+    }
+    catch(...)
+    {
       currentTask = prev;
-      task = (*current)->task;
+      slice = prevSlice;
+      throw;
+    }
 
-      //Check if task was deleted
-      if(isRemoved)
+    currentTask = prev;
+    slice = prevSlice;
+    task = (*current)->task;
+
+    //Check if task was deleted
+    if(isRemoved)
+    {
+      coroutines.erase(task);
+      isRemoved = false;
+      return;
+    }
+
+    if((*current)->status() != Coroutine::Status::STOPPED)
+    {
+      if(task)
       {
-        coroutines.erase(task);
-        isRemoved = false;
-        return;
+        task->state = Status::PAUSED;
       }
-
-      if((*current)->status() != Coroutine::Status::STOPPED)
+    }
+    else
+    {
+      if(task)
       {
-        if(task)
+        bool wasCancelled = (*current)->cancelled;
+        task->state = Status::IDLE;
+        (*current)->task = nullptr;
+        (*current)->cancelled = false;
+
+        //A real-time task keeps its prefaulted stack for its next launch
+        if(!task->realtime)
+        {
+          coroutines.erase(task);
+        }
+
+        //A deadline only applies until the task returns to idle
+        unwatch(task);
+        task->limited = false;
+
+        if(wasCancelled)
         {
-          task->state = Status::PAUSED;
+          OVK_DEBUG("Task %p cancelled.", task);
+          task->cancelled();
         }
       }
-      else
+    }
+  }
+
+  void Task::InterruptibleManager::schedule(Task *task)
+  {
+    if(task->scheduled)
+      return;
+
+    task->scheduled = true;
+    task->next = nullptr;
+
+    if(ready.tail)
+    {
+      ready.tail->next = task;
+    }
+    else
+    {
+      ready.head = task;
+    }
+
+    ready.tail = task;
+    ready.length++;
+  }
+
+  void Task::InterruptibleManager::dispatch()
+  {
+    //Tasks scheduled while dispatching wait for the next dispatch
+    ready.last = ready.tail;
+
+    while(ready.last)
+    {
+      Task *task = ready.head;
+      ready.head = task->next;
+
+      if(!ready.head)
       {
-        if(task)
+        ready.tail = nullptr;
+      }
+
+      if(task == ready.last)
+      {
+        ready.last = nullptr;
+      }
+
+      task->next = nullptr;
+      task->scheduled = false;
+      ready.length--;
+      auto it = coroutines.find(task);
+
+      if(it != coroutines.end() && it->second->status() == Coroutine::Status::PAUSED)
+      {
+        try
         {
-          task->state = Status::IDLE;
-          (*current)->task = nullptr;
-          coroutines.erase(task);
+          run(task, &it->second);
         }
+        catch(...)
+        {
+          reset(task);
+          throw;
+        }
+      }
+    }
+  }
+
+  bool Task::InterruptibleManager::pending() const
+  {
+    return ready.head != nullptr;
+  }
+
+  void Task::InterruptibleManager::setBudget(const Time::Elapsed& time, size_t iterations)
+  {
+    budget.time = time;
+    budget.iterations = iterations;
+  }
+
+  Task *Task::InterruptibleManager::current() const
+  {
+    return currentTask;
+  }
+
+  bool Task::InterruptibleManager::cancel(Task *task)
+  {
+    if(task->manager != this || task->state == Status::IDLE
+       || coroutines.find(task) == coroutines.end())
+    {
+      return false;
+    }
+
+    task->cancelling = true;
+
+    //A running task is unwound at its next suspension point
+    if(task->state == Status::PAUSED)
+    {
+      schedule(task);
+    }
+
+    return true;
+  }
+
+  void Task::InterruptibleManager::watch(Task *task)
+  {
+    unwatch(task);
+    bool earliest = deadlines.empty() || task->deadline < deadlines.begin()->first;
+    deadlines.insert(std::make_pair(task->deadline, task));
+    task->watched = true;
+
+    if(earliest)
+    {
+      if(!timer)
+      {
+        timer = new Deadline(this);
+      }
+
+      timer->setTime(task->deadline);
+      timer->start();
+    }
+  }
+
+  void Task::InterruptibleManager::unwatch(Task *task)
+  {
+    if(!task->watched)
+    {
+      return;
+    }
+
+    auto range = deadlines.equal_range(task->deadline);
+
+    for(auto it = range.first; it != range.second; ++it)
+    {
+      if(it->second == task)
+      {
+        deadlines.erase(it);
+        break;
+      }
+    }
+
+    task->watched = false;
+
+    //A later deadline is only checked again when the timer expires
+    if(deadlines.empty() && timer)
+    {
+      timer->stop();
+    }
+  }
+
+  void Task::InterruptibleManager::expire()
+  {
+    Time::Monotonic now = Time::Monotonic::cached();
+
+    while(!deadlines.empty() && deadlines.begin()->first <= now)
+    {
+      Task *task = deadlines.begin()->second;
+      deadlines.erase(deadlines.begin());
+      task->watched = false;
+      task->limited = false;
+
+      if(cancel(task))
+      {
+        OVK_INFO("Task %p deadline reached. Cancel it.", task);
       }
     }
+
+    if(!deadlines.empty())
+    {
+      timer->setTime(deadlines.begin()->first);
+      timer->start();
+    }
+  }
+
+  bool Task::InterruptibleManager::exhausted()
+  {
+    if(budget.iterations && ++slice.iterations >= budget.iterations)
+    {
+      return true;
+    }
+
+    if(budget.time.seconds || budget.time.nanoseconds)
+    {
+      return Time::Monotonic::fast() - slice.start >= budget.time;
+    }
+
+    return false;
   }
 
   void Task::InterruptibleManager::reset(Task *task)
@@ -166,12 +528,18 @@ namespace Overkiz
     {
       // Reset coroutine
       task->state = Status::IDLE;
-      coroutines[task] = Shared::Pointer<Coroutine>::create(task->stackSize);
+      task->cancelling = false;
+      unwatch(task);
+      task->limited = false;
+      coroutines[task] = create(task);
     }
   }
 
   void Task::InterruptibleManager::remove(Task *task)
   {
+    unwatch(task);
+    unschedule(task);
+
     if(currentTask == task)
     {
       //It's not possible to remove this coroutine here, because we are using his stack
@@ -186,15 +554,141 @@ namespace Overkiz
     }
   }
 
+  void Task::InterruptibleManager::unwind(Task *task)
+  {
+    auto it = coroutines.find(task);
+
+    if(task == currentTask || it == coroutines.end() || it->second->status() != Coroutine::Status::PAUSED)
+    {
+      return;
+    }
+
+    //The task is destroyed, only its base hooks are called
+    task->cancelling = true;
+    Shared::Pointer<Coroutine> coroutine = it->second;
+    run(task, &coroutine);
+
+    if(coroutine->status() == Coroutine::Status::PAUSED)
+    {
+      OVK_ERROR("Task %p destroyed while paused, it ignored its cancellation.", task);
+      //Never resumed again, even if a queue wakes it
+      coroutine->task = nullptr;
+      coroutines.erase(task);
+    }
+  }
+
+  void Task::InterruptibleManager::unschedule(Task *task)
+  {
+    if(task->scheduled)
+    {
+      Task **it = &ready.head;
+      Task *prev = nullptr;
+
+      while(*it && *it != task)
+      {
+        prev = *it;
+        it = &(*it)->next;
+      }
+
+      if(*it)
+      {
+        *it = task->next;
+      }
+
+      if(ready.tail == task)
+      {
+        ready.tail = prev;
+      }
+
+      if(ready.last == task)
+      {
+        ready.last = prev;
+      }
+
+      task->next = nullptr;
+      task->scheduled = false;
+      ready.length--;
+    }
+  }
+
+  bool Task::InterruptibleManager::release(Task *task, Shared::Pointer<Coroutine>& coroutine, bool& wasScheduled)
+  {
+    auto it = coroutines.find(task);
+
+    if(task == currentTask || task->manager != this || task->state != Status::PAUSED
+       || it == coroutines.end() || it->second->status() != Coroutine::Status::PAUSED)
+    {
+      return false;
+    }
+
+    wasScheduled = task->scheduled;
+    coroutine = it->second;
+    unwatch(task);
+    unschedule(task);
+    coroutines.erase(it);
+    coroutine->manager = nullptr;
+    task->manager = nullptr;
+    return true;
+  }
+
+  void Task::InterruptibleManager::adopt(Task *task, Shared::Pointer<Coroutine>& coroutine, bool wasScheduled)
+  {
+    coroutines[task] = coroutine;
+    coroutine->manager = this;
+    task->manager = this;
+
+    if(task->limited)
+    {
+      watch(task);
+    }
+
+    if(wasScheduled)
+    {
+      schedule(task);
+    }
+  }
+
+  Task *Task::InterruptibleManager::migratable() const
+  {
+    Task *found = nullptr;
+
+    for(Task *task = ready.head; task; task = task->next)
+    {
+      if(task->movable && task != currentTask)
+      {
+        found = task;
+      }
+    }
+
+    return found;
+  }
+
   void Task::InterruptibleManager::reset()
   {
+    while(ready.head)
+    {
+      remove(ready.head);
+    }
+
     coroutines.clear();
+
+    while(!deadlines.empty())
+    {
+      unwatch(deadlines.begin()->second);
+    }
+  }
+
+  Shared::Pointer<Task::InterruptibleManager::Coroutine> Task::InterruptibleManager::create(Task *task)
+  {
+    return Shared::Pointer<Coroutine>::create(task->stackSize, task->stackOptions());
   }
 
-  Task::InterruptibleManager::Coroutine::Coroutine(size_t stackSize) :
-    Overkiz::Coroutine(stackSize)
+  Task::InterruptibleManager::Coroutine::Coroutine(size_t stackSize, unsigned options) :
+    Overkiz::Coroutine(stackSize, options)
   {
     task = nullptr;
+    manager = nullptr;
+    cancelled = false;
   }
 
   Task::InterruptibleManager::Coroutine::~Coroutine()
@@ -206,12 +700,21 @@ namespace Overkiz
     if(task)
     {
       task->state = Task::Status::RUNNING;
-      task->entry();
+
+      try
+      {
+        task->entry();
+      }
+      catch(const CancelledException&)
+      {
+        cancelled = true;
+      }
     }
 
     if(task)
     {
       task->state = Task::Status::IDLE;
+      task->cancelling = false;
     }
   }
 
@@ -233,4 +736,44 @@ namespace Overkiz
     }
   }
 
+  void Task::InterruptibleManager::Coroutine::resumed()
+  {
+    if(task && task->cancelling)
+    {
+      throw CancelledException();
+    }
+  }
+
+  bool Task::InterruptibleManager::Coroutine::preempt()
+  {
+    if(!task || !manager || manager->currentTask != task)
+    {
+      return false;
+    }
+
+    if(task->cancelling)
+    {
+      throw CancelledException();
+    }
+
+    return manager->exhausted();
+  }
+
+  bool Task::InterruptibleManager::Coroutine::reschedule()
+  {
+    //The paused coroutine of a destroyed task is never resumed
+    if(!task)
+    {
+      return true;
+    }
+
+    if(manager)
+    {
+      manager->schedule(task);
+      return true;
+    }
+
+    return false;
+  }
+
 }
@@ -0,0 +1,258 @@
+/*
+ * Watchdog.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <cxxabi.h>
+#include <execinfo.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <typeinfo>
+
+#include <kizbox/framework/core/Errno.h>
+#include <kizbox/framework/core/Log.h>
+#include "Watchdog.h"
+
+#define ALT_STACK_SIZE (64 * 1024)
+
+namespace Overkiz
+{
+
+  Poller::Watchdog::Watchdog(const Time::Elapsed& limit, Delegate *watchdogDelegate) :
+    poller(&*Poller::get()), delegate(watchdogDelegate), target(pthread_self()),
+    altStack(nullptr), since(0), generation(0), task(nullptr), captured(false)
+  {
+    threshold = (uint64_t) limit.seconds * 1000000000ULL + limit.nanoseconds;
+
+    //The first backtrace loads the unwinder, it must not happen in the handler
+    void *frame;
+    backtrace(&frame, 1);
+
+    static bool installed = false;
+
+    if(!installed)
+    {
+      struct sigaction action;
+      memset(&action, 0, sizeof(action));
+      action.sa_sigaction = &Watchdog::capture;
+      action.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+      sigemptyset(&action.sa_mask);
+
+      if(sigaction(SIGRTMIN + 1, &action, nullptr) != 0)
+      {
+        throw Overkiz::Errno::Exception();
+      }
+
+      installed = true;
+    }
+
+    //The poller thread may be interrupted on a small task stack
+    stack_t stack;
+
+    if(sigaltstack(nullptr, &stack) == 0 && (stack.ss_flags & SS_DISABLE))
+    {
+      altStack = malloc(ALT_STACK_SIZE);
+      stack.ss_sp = altStack;
+      stack.ss_size = ALT_STACK_SIZE;
+      stack.ss_flags = 0;
+
+      if(!altStack || sigaltstack(&stack, nullptr) != 0)
+      {
+        free(altStack);
+        throw Overkiz::Errno::Exception();
+      }
+    }
+
+    fd = eventfd(0, EFD_CLOEXEC);
+
+    if(fd == -1)
+    {
+      throw Overkiz::Errno::Exception();
+    }
+
+    int ret = pthread_create(&thread, nullptr, &Watchdog::run, this);
+
+    if(ret != 0)
+    {
+      close(fd);
+      throw Overkiz::Errno::Exception(ret);
+    }
+
+    poller->watchdog = this;
+  }
+
+  Poller::Watchdog::~Watchdog()
+  {
+    if(poller && poller->watchdog == this)
+    {
+      poller->watchdog = nullptr;
+    }
+
+    uint64_t value = 1;
+
+    if(write(fd, &value, sizeof(value)) < 0)
+    {
+      OVK_ERROR("Couldn't stop the watchdog thread.");
+    }
+
+    pthread_join(thread, nullptr);
+    close(fd);
+
+    if(altStack)
+    {
+      stack_t stack;
+      memset(&stack, 0, sizeof(stack));
+      stack.ss_flags = SS_DISABLE;
+      sigaltstack(&stack, nullptr);
+      free(altStack);
+    }
+  }
+
+  void Poller::Watchdog::enter(Task *resumed)
+  {
+    task.store(resumed, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_relaxed);
+    since.store(now(), std::memory_order_release);
+  }
+
+  void Poller::Watchdog::leave()
+  {
+    since.store(0, std::memory_order_release);
+  }
+
+  void Poller::Watchdog::watch()
+  {
+    //Check several times per threshold, but not more than every 10ms
+    int interval = (int) (threshold / 4000000);
+    uint32_t reported = generation.load();
+
+    if(interval < 10)
+    {
+      interval = 10;
+    }
+
+    struct pollfd stop;
+    stop.fd = fd;
+    stop.events = POLLIN;
+
+    while(poll(&stop, 1, interval) == 0 || (stop.revents & POLLIN) == 0)
+    {
+      uint64_t start = since.load(std::memory_order_acquire);
+      uint32_t current = generation.load(std::memory_order_relaxed);
+
+      if(!start || current == reported || now() - start < threshold)
+      {
+        continue;
+      }
+
+      reported = current;
+      captured.store(false);
+      union sigval value;
+      value.sival_ptr = this;
+
+      if(pthread_sigqueue(target, SIGRTMIN + 1, value) != 0)
+      {
+        continue;
+      }
+
+      //The handler runs as soon as the poller thread is scheduled
+      for(int i = 0; i < 100 && !captured.load(std::memory_order_acquire); i++)
+      {
+        poll(nullptr, 0, 1);
+      }
+
+      if(!captured.load(std::memory_order_acquire))
+      {
+        OVK_WARNING("Poller blocked but its stack couldn't be captured.");
+        continue;
+      }
+
+      uint64_t elapsed = now() - start;
+      sample.elapsed.seconds = elapsed / 1000000000ULL;
+      sample.elapsed.nanoseconds = elapsed % 1000000000ULL;
+
+      if(delegate)
+      {
+        delegate->blocked(sample);
+      }
+      else
+      {
+        log(sample);
+      }
+    }
+  }
+
+  void *Poller::Watchdog::run(void *watchdog)
+  {
+    static_cast<Watchdog *>(watchdog)->watch();
+    return nullptr;
+  }
+
+  void Poller::Watchdog::capture(int sig, siginfo_t *info, void *context)
+  {
+    Watchdog *watchdog = static_cast<Watchdog *>(info->si_value.sival_ptr);
+
+    if(!watchdog || info->si_code != SI_QUEUE)
+    {
+      return;
+    }
+
+    Task *running = nullptr;
+
+    //The innermost resumed task is more accurate than the dispatched watcher
+    if(watchdog->poller && watchdog->poller->taskManager)
+    {
+      running = watchdog->poller->taskManager->current();
+    }
+
+    if(!running)
+    {
+      running = watchdog->task.load(std::memory_order_relaxed);
+    }
+
+    watchdog->sample.task = running;
+    watchdog->sample.type = running ? typeid(*running).name() : nullptr;
+    watchdog->sample.depth = backtrace(watchdog->sample.frames, DEPTH);
+    watchdog->captured.store(true, std::memory_order_release);
+  }
+
+  void Poller::Watchdog::log(const Report& report)
+  {
+    int status = -1;
+    char *name = report.type ? abi::__cxa_demangle(report.type, nullptr, nullptr, &status) : nullptr;
+
+    OVK_WARNING("Poller blocked for %li.%09li seconds by task <%p> (%s):", (long) report.elapsed.seconds,
+                (long) report.elapsed.nanoseconds, report.task,
+                status == 0 ? name : report.type ? report.type : "unknown");
+    free(name);
+
+    char **symbols = backtrace_symbols(report.frames, report.depth);
+
+    //Skip the signal handler
+    for(int i = 1; i < report.depth; i++)
+    {
+      if(symbols)
+      {
+        OVK_WARNING("  #%d %s", i - 1, symbols[i]);
+      }
+      else
+      {
+        OVK_WARNING("  #%d %p", i - 1, report.frames[i]);
+      }
+    }
+
+    free(symbols);
+  }
+
+  uint64_t Poller::Watchdog::now()
+  {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000ULL + time.tv_nsec;
+  }
+
+}
@@ -19,12 +19,21 @@ namespace Overkiz
     fd = -1;
     events = 0;
     current = 0;
+    priority = 0;
+    polled = false;
+    registry = nullptr;
+    statistics.dispatches = 0;
+    track(Poller::exists() ? &*Poller::get() : nullptr);
   }
 
   Watcher::Watcher(const Watcher& src)
   {
     events = src.events;
     current = 0;
+    priority = src.priority;
+    polled = false;
+    registry = nullptr;
+    statistics.dispatches = 0;
 
     if(src.fd >= 0)
     {
@@ -34,6 +43,8 @@ namespace Overkiz
     {
       fd = -1;
     }
+
+    track(Poller::exists() ? &*Poller::get() : nullptr);
   }
 
   Watcher::Watcher(int newFd, uint32_t newEvents)
@@ -41,6 +52,11 @@ namespace Overkiz
     fd = newFd;
     events = newEvents;
     current = 0;
+    priority = 0;
+    polled = false;
+    registry = nullptr;
+    statistics.dispatches = 0;
+    track(Poller::exists() ? &*Poller::get() : nullptr);
   }
 
   Watcher::~Watcher()
@@ -70,6 +86,31 @@ namespace Overkiz
     }
   }
 
+  void Watcher::setPriority(int newPriority)
+  {
+    if(newPriority == priority)
+    {
+      return;
+    }
+
+    //Urgent watchers are registered in another epoll set
+    if(!manager.empty() && (newPriority > 0) != (priority > 0))
+    {
+      manager->remove(this);
+      priority = newPriority;
+      manager->add(this);
+    }
+    else
+    {
+      priority = newPriority;
+    }
+  }
+
+  int Watcher::getPriority() const
+  {
+    return priority;
+  }
+
   void Watcher::start()
   {
     enable();
@@ -85,6 +126,24 @@ namespace Overkiz
     process(current);
   }
 
+  void Watcher::track(Poller *poller)
+  {
+    if(registry == poller)
+    {
+      return;
+    }
+
+    if(registry)
+    {
+      registry->untrack(this);
+    }
+
+    if(poller)
+    {
+      poller->track(this);
+    }
+  }
+
   void Watcher::save()
   {
     if(!manager.empty())
@@ -99,12 +158,20 @@ namespace Overkiz
     if(isEnabled())
     {
       manager = Poller::get();
+      //The task may have been migrated to another thread
+      track(&*manager);
       manager->add(this);
     }
   }
 
   void Watcher::cleanup()
   {
+    if(registry && registry->dispatching == this)
+    {
+      registry->dispatching = nullptr;
+    }
+
+    track(nullptr);
     manager = Shared::Pointer<Poller>();
   }
 
@@ -131,6 +198,7 @@ namespace Overkiz
         }
       }
 
+      track(&*manager);
       manager->add(this);
     }
 
@@ -0,0 +1,288 @@
+/*
+ * Clock.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+
+#include <kizbox/framework/core/Thread.h>
+#include "Clock.h"
+
+#define CLOCK_SOURCE_PATH "/sys/devices/system/clocksource/clocksource0/current_clocksource"
+
+//Calibration delay of the TSC in ns
+#define CLOCK_CALIBRATION 10000000
+
+namespace Overkiz
+{
+
+  namespace Time
+  {
+
+    namespace
+    {
+
+      /**
+       * Time of the current iteration of the poller of a thread.
+       */
+      struct Cache
+      {
+        bool active;
+        bool monotonic;
+        bool real;
+        struct timespec times[2];
+      };
+
+      __thread Cache cache = {false, false, false, {{0, 0}, {0, 0}}};
+
+      /**
+       * Conversion of the cycle counter, set once before being ready.
+       */
+      struct Counter
+      {
+        std::atomic<int> state; //!< 0 if not calibrated, 1 if usable, -1 if not
+        std::atomic<bool> enabled;
+        uint64_t base;
+        uint64_t nanoseconds;
+        uint64_t scale; //!< nanoseconds per cycle, shifted by 32 bits
+      };
+
+      Counter counter = {{0}, {false}, 0, 0, 0};
+
+      #if defined(__x86_64__) || defined(__i386__)
+      #define CLOCK_COUNTER_SOURCE "tsc"
+
+      inline uint64_t cycles()
+      {
+        uint32_t low, high;
+        __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+        return ((uint64_t) high << 32) | low;
+      }
+
+      uint64_t frequency()
+      {
+        return 0;
+      }
+      #elif defined(__aarch64__)
+      #define CLOCK_COUNTER_SOURCE "arch_sys_counter"
+
+      inline uint64_t cycles()
+      {
+        uint64_t value;
+        __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(value) : : "memory");
+        return value;
+      }
+
+      uint64_t frequency()
+      {
+        uint64_t value;
+        __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(value));
+        return value;
+      }
+      #elif defined(__arm__) && defined(__ARM_ARCH) && __ARM_ARCH >= 7
+      #define CLOCK_COUNTER_SOURCE "arch_sys_counter"
+
+      inline uint64_t cycles()
+      {
+        uint64_t value;
+        __asm__ __volatile__("isb; mrrc p15, 1, %Q0, %R0, c14" : "=r"(value) : : "memory");
+        return value;
+      }
+
+      uint64_t frequency()
+      {
+        uint32_t value;
+        __asm__ __volatile__("mrc p15, 0, %0, c14, c0, 0" : "=r"(value));
+        return value;
+      }
+      #else
+      #define CLOCK_COUNTER_SOURCE ""
+
+      inline uint64_t cycles()
+      {
+        return 0;
+      }
+
+      uint64_t frequency()
+      {
+        return 0;
+      }
+      #endif
+
+      inline uint64_t nanoseconds(const struct timespec& time)
+      {
+        return (uint64_t) time.tv_sec * 1000000000ULL + time.tv_nsec;
+      }
+
+      /**
+       * (value * scale) >> 32 without 128 bits integers.
+       */
+      inline uint64_t multiply(uint64_t value, uint64_t scale)
+      {
+        uint64_t vh = value >> 32, vl = value & 0xffffffff;
+        uint64_t sh = scale >> 32, sl = scale & 0xffffffff;
+        return ((vh * sh) << 32) + vh * sl + vl * sh + ((vl * sl) >> 32);
+      }
+
+      /**
+       * Read the counter and CLOCK_MONOTONIC at the same time.
+       *
+       * @param time : CLOCK_MONOTONIC in ns.
+       * @return the counter.
+       */
+      uint64_t sample(uint64_t& time)
+      {
+        struct timespec before, after;
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        uint64_t value = cycles();
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        time = (nanoseconds(before) + nanoseconds(after)) / 2;
+        return value;
+      }
+
+    }
+
+    void Clock::tick()
+    {
+      cache.active = true;
+      cache.monotonic = false;
+      cache.real = false;
+    }
+
+    void Clock::release()
+    {
+      cache.active = false;
+    }
+
+    void Clock::monotonic(struct timespec & time)
+    {
+      if(!cache.active)
+      {
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return;
+      }
+
+      if(!cache.monotonic)
+      {
+        clock_gettime(CLOCK_MONOTONIC, &cache.times[0]);
+        cache.monotonic = true;
+      }
+
+      time = cache.times[0];
+    }
+
+    void Clock::real(struct timespec & time)
+    {
+      if(!cache.active)
+      {
+        clock_gettime(CLOCK_REALTIME, &time);
+        return;
+      }
+
+      if(!cache.real)
+      {
+        clock_gettime(CLOCK_REALTIME, &cache.times[1]);
+        cache.real = true;
+      }
+
+      time = cache.times[1];
+    }
+
+    void Clock::fast(struct timespec & time)
+    {
+      if(!counter.enabled.load(std::memory_order_acquire))
+      {
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return;
+      }
+
+      uint64_t value = cycles();
+      uint64_t elapsed = counter.nanoseconds;
+
+      //Another core may be slightly late at the calibration
+      if(value > counter.base)
+      {
+        elapsed += multiply(value - counter.base, counter.scale);
+      }
+
+      time.tv_sec = elapsed / 1000000000ULL;
+      time.tv_nsec = elapsed % 1000000000ULL;
+    }
+
+    bool Clock::setCounter(bool enabled)
+    {
+      if(!enabled)
+      {
+        counter.enabled = false;
+        return true;
+      }
+
+      if(!calibrate())
+      {
+        return false;
+      }
+
+      counter.enabled = true;
+      return true;
+    }
+
+    bool Clock::hasCounter()
+    {
+      return counter.enabled;
+    }
+
+    bool Clock::calibrate()
+    {
+      static Thread::Lock lock;
+      lock.acquire();
+
+      if(counter.state == 0)
+      {
+        char source[32] = {0};
+        int fd = open(CLOCK_SOURCE_PATH, O_RDONLY | O_CLOEXEC);
+        counter.state = -1;
+
+        if(fd != -1)
+        {
+          ssize_t size = read(fd, source, sizeof(source) - 1);
+          close(fd);
+
+          //The kernel only keeps its own clock source stable between the cores
+          if(size > 0 && *CLOCK_COUNTER_SOURCE && strcmp(source, CLOCK_COUNTER_SOURCE "\n") == 0)
+          {
+            uint64_t rate = frequency();
+            uint64_t time;
+            counter.base = sample(time);
+            counter.nanoseconds = time;
+
+            if(rate)
+            {
+              counter.scale = (1000000000ULL << 32) / rate;
+            }
+            else
+            {
+              struct timespec delay = {0, CLOCK_CALIBRATION};
+              nanosleep(&delay, nullptr);
+              uint64_t end;
+              uint64_t value = sample(end);
+              //ns per cycle with 32 bits of fraction, the delay is below 4.2s
+              counter.scale = value > counter.base ? ((end - time) << 32) / (value - counter.base) : 0;
+            }
+
+            counter.state = counter.scale ? 1 : -1;
+          }
+        }
+      }
+
+      lock.release();
+      return counter.state == 1;
+    }
+
+  }
+
+}
@@ -13,6 +13,7 @@
 #include <linux/rtc.h>
 #include <cerrno>
 
+#include "Clock.h"
 #include "Time.h"
 
 #ifndef RTC_SANITY_CHECK_YEAR
@@ -135,6 +136,20 @@ namespace Overkiz
       return Real();
     }
 
+    Real Real::coarse()
+    {
+      struct timespec time;
+      clock_gettime(CLOCK_REALTIME_COARSE, &time);
+      return Real(Elapsed(time.tv_sec, time.tv_nsec));
+    }
+
+    Real Real::cached()
+    {
+      struct timespec time;
+      Clock::real(time);
+      return Real(Elapsed(time.tv_sec, time.tv_nsec));
+    }
+
     Real::operator Elapsed() const
     {
       Elapsed epoch;
@@ -511,9 +526,28 @@ namespace Overkiz
 
     Monotonic Monotonic::now()
     {
-      Monotonic time;
-      clock_gettime(CLOCK_MONOTONIC, &time.ts);
-      return time;
+      return Monotonic();
+    }
+
+    Monotonic Monotonic::coarse()
+    {
+      struct timespec time;
+      clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+      return Monotonic(Elapsed(time.tv_sec, time.tv_nsec));
+    }
+
+    Monotonic Monotonic::cached()
+    {
+      struct timespec time;
+      Clock::monotonic(time);
+      return Monotonic(Elapsed(time.tv_sec, time.tv_nsec));
+    }
+
+    Monotonic Monotonic::fast()
+    {
+      struct timespec time;
+      Clock::fast(time);
+      return Monotonic(Elapsed(time.tv_sec, time.tv_nsec));
     }
 
     Monotonic::operator Elapsed() const
@@ -168,6 +168,11 @@ namespace Overkiz
       }
     }
 
+    size_t Real::Manager::clients() const
+    {
+      return timers.size();
+    }
+
     void Real::Manager::process(uint32_t evts)
     {
       if(evts & EPOLLIN)
@@ -205,7 +210,7 @@ namespace Overkiz
           }
         }
 
-        Time::Real now = Time::Real::now(); //(clock);
+        Time::Real now = Time::Real::cached();
 
         while((i = timers.begin()) != timers.end())
         {
@@ -520,6 +525,11 @@ namespace Overkiz
       }
     }
 
+    size_t Monotonic::Manager::clients() const
+    {
+      return timers.size();
+    }
+
     void Monotonic::Manager::process(uint32_t evts)
     {
       if(evts & EPOLLIN)
@@ -540,7 +550,7 @@ namespace Overkiz
           }
         }
 
-        Time::Monotonic now = Time::Monotonic::now(); //(clock);
+        Time::Monotonic now = Time::Monotonic::cached();
         std::list<Monotonic *>::iterator i;
 
         while((i = timers.begin()) != timers.end())
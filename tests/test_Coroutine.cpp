@@ -0,0 +1,563 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestFixture.h>
+#include <kizbox/framework/core/Coroutine.h>
+#include <kizbox/framework/core/Channel.h>
+#include <kizbox/framework/core/Event.h>
+#include <kizbox/framework/core/Generator.h>
+#include <kizbox/framework/core/Poller.h>
+#include <kizbox/framework/core/Synchronization.h>
+
+class Counted
+{
+public:
+  Counted() :
+    value(0)
+  {
+    instances++;
+  }
+
+  ~Counted()
+  {
+    instances--;
+  }
+
+  int value;
+  static int instances;
+};
+
+int Counted::instances = 0;
+
+static Overkiz::Coroutine::Local<Counted> local;
+
+class LocalCoroutine : public Overkiz::Coroutine
+{
+public:
+  LocalCoroutine(int value) :
+    Overkiz::Coroutine(4 * 4096), value(value), seen(-1)
+  {
+  }
+
+  void entry()
+  {
+    local->value = value;
+    Overkiz::Coroutine::yield();
+    seen = local->value;
+  }
+
+  int value;
+  int seen;
+};
+
+typedef Overkiz::Coroutine::Channel<int, 2> IntChannel;
+
+class ReceiverCoroutine : public Overkiz::Coroutine
+{
+public:
+  ReceiverCoroutine(IntChannel& channel) :
+    Overkiz::Coroutine(4 * 4096), channel(channel), sum(0), count(0)
+  {
+  }
+
+  void entry()
+  {
+    int value;
+
+    while(channel.receive(value))
+    {
+      sum += value;
+      count++;
+    }
+  }
+
+  IntChannel& channel;
+  int sum;
+  int count;
+};
+
+class BulkEvent : public Overkiz::Event
+{
+public:
+  BulkEvent() :
+    yields(0)
+  {
+  }
+
+  void receive(uint64_t numberOfEvents)
+  {
+    for(int i = 0; i < 100; i++)
+    {
+      if(Overkiz::Coroutine::maybeYield())
+      {
+        yields++;
+      }
+    }
+
+    Overkiz::Poller::get()->stop();
+  }
+
+  int yields;
+};
+
+class LockerCoroutine : public Overkiz::Coroutine
+{
+public:
+  LockerCoroutine(Overkiz::Coroutine::Mutex& mutex, std::vector<int>& order, int id) :
+    Overkiz::Coroutine(4 * 4096), mutex(mutex), order(order), id(id)
+  {
+  }
+
+  void entry()
+  {
+    mutex.lock();
+    order.push_back(id);
+    Overkiz::Coroutine::yield();
+    mutex.unlock();
+  }
+
+  Overkiz::Coroutine::Mutex& mutex;
+  std::vector<int>& order;
+  int id;
+};
+
+class StuckEvent : public Overkiz::Event
+{
+public:
+  StuckEvent() :
+    reached(false), unwound(false), instances(0)
+  {
+    //Unwinding needs more than the default stack
+    setStackSize(16 * 4096);
+  }
+
+  void receive(uint64_t numberOfEvents)
+  {
+    Counted guard;
+    instances = Counted::instances;
+    Overkiz::Time::Elapsed timeout = { 0, 20000000 };
+    setDeadline(Overkiz::Time::Monotonic::now() + timeout);
+    int value;
+    //Nobody sends anything
+    channel.receive(value);
+    reached = true;
+  }
+
+  void cancelled()
+  {
+    unwound = Counted::instances == instances - 1;
+    Overkiz::Poller::get()->stop();
+  }
+
+  IntChannel channel;
+  bool reached;
+  bool unwound;
+  int instances;
+};
+
+class BlockedEvent : public Overkiz::Event
+{
+public:
+  BlockedEvent(Overkiz::Coroutine::Mutex& mutex, Overkiz::Coroutine::Semaphore& semaphore) :
+    mutex(mutex), semaphore(semaphore), granter(nullptr), acquired(false), unwound(false)
+  {
+    setStackSize(16 * 4096);
+  }
+
+  void receive(uint64_t numberOfEvents)
+  {
+    Overkiz::Time::Elapsed timeout = { 0, 20000000 };
+    setDeadline(Overkiz::Time::Monotonic::now() + timeout);
+
+    if(granter)
+    {
+      //Granted then cancelled before being resumed
+      granter->send();
+      semaphore.acquire();
+    }
+    else
+    {
+      mutex.lock();
+    }
+
+    acquired = true;
+  }
+
+  void cancelled()
+  {
+    unwound = true;
+    Overkiz::Poller::get()->stop();
+  }
+
+  Overkiz::Coroutine::Mutex& mutex;
+  Overkiz::Coroutine::Semaphore& semaphore;
+  Overkiz::Event *granter;
+  bool acquired;
+  bool unwound;
+};
+
+class GranterEvent : public Overkiz::Event
+{
+public:
+  GranterEvent(Overkiz::Coroutine::Semaphore& semaphore, BlockedEvent& blocked) :
+    semaphore(semaphore), blocked(blocked)
+  {
+  }
+
+  void receive(uint64_t numberOfEvents)
+  {
+    semaphore.release();
+    blocked.cancel();
+  }
+
+  Overkiz::Coroutine::Semaphore& semaphore;
+  BlockedEvent& blocked;
+};
+
+class WaitingEvent : public Overkiz::Event
+{
+public:
+  WaitingEvent(IntChannel& channel) :
+    channel(channel), waiting(false), received(false)
+  {
+    setStackSize(16 * 4096);
+  }
+
+  void receive(uint64_t numberOfEvents)
+  {
+    Counted guard;
+    int value;
+    waiting = true;
+    received = channel.receive(value);
+  }
+
+  IntChannel& channel;
+  bool waiting;
+  bool received;
+};
+
+class SelectingEvent : public Overkiz::Event
+{
+public:
+  SelectingEvent(IntChannel& first, IntChannel& second) :
+    first(first), second(second), waiting(false), index(-1)
+  {
+    setStackSize(16 * 4096);
+  }
+
+  void receive(uint64_t numberOfEvents)
+  {
+    Overkiz::Coroutine::Select<2> select;
+    select.receive(first);
+    select.receive(second);
+    int value;
+    waiting = true;
+    index = select.wait();
+    (index == 0 ? first : second).receive(value);
+  }
+
+  IntChannel& first;
+  IntChannel& second;
+  bool waiting;
+  int index;
+};
+
+class RealtimeEvent : public Overkiz::Event
+{
+public:
+  RealtimeEvent() :
+    runs(0), options(0)
+  {
+    setRealtime(true, true);
+  }
+
+  void receive(uint64_t numberOfEvents)
+  {
+    int local;
+    options = Overkiz::Coroutine::self()->stackOptions();
+    frames[runs++] = &local;
+
+    if(runs == 2)
+    {
+      Overkiz::Poller::get()->stop();
+    }
+    else
+    {
+      send();
+    }
+  }
+
+  int runs;
+  unsigned options;
+  void *frames[2];
+};
+
+class CoroutineTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE(CoroutineTest);
+  CPPUNIT_TEST(localStorage);
+  CPPUNIT_TEST(channel);
+  CPPUNIT_TEST(budget);
+  CPPUNIT_TEST(generator);
+  CPPUNIT_TEST(mutex);
+  CPPUNIT_TEST(deadline);
+  CPPUNIT_TEST(cancelWaiting);
+  CPPUNIT_TEST(deleteWaiting);
+  CPPUNIT_TEST(selectShared);
+  CPPUNIT_TEST(realtime);
+  CPPUNIT_TEST_SUITE_END();
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+protected:
+  void localStorage()
+  {
+    Overkiz::Shared::Pointer<LocalCoroutine> first = Overkiz::Shared::Pointer<LocalCoroutine>::create(1);
+    Overkiz::Shared::Pointer<LocalCoroutine> second = Overkiz::Shared::Pointer<LocalCoroutine>::create(2);
+    local->value = 3;
+    Overkiz::Coroutine::resume(first);
+    Overkiz::Coroutine::resume(second);
+    CPPUNIT_ASSERT(Counted::instances == 3);
+    Overkiz::Coroutine::resume(first);
+    Overkiz::Coroutine::resume(second);
+    CPPUNIT_ASSERT(first->seen == 1);
+    CPPUNIT_ASSERT(second->seen == 2);
+    CPPUNIT_ASSERT(local->value == 3);
+    CPPUNIT_ASSERT(Counted::instances == 1);
+    local.reset();
+    CPPUNIT_ASSERT(local.empty());
+    CPPUNIT_ASSERT(Counted::instances == 0);
+  }
+
+  void channel()
+  {
+    IntChannel channel;
+    Overkiz::Shared::Pointer<ReceiverCoroutine> receiver = Overkiz::Shared::Pointer<ReceiverCoroutine>::create(channel);
+    CPPUNIT_ASSERT(channel.trySend(1));
+    CPPUNIT_ASSERT(channel.trySend(2));
+    CPPUNIT_ASSERT(!channel.trySend(3));
+    CPPUNIT_ASSERT(channel.full());
+    Overkiz::Coroutine::resume(receiver);
+    CPPUNIT_ASSERT(channel.empty());
+    CPPUNIT_ASSERT(receiver->count == 2);
+    CPPUNIT_ASSERT(channel.trySend(4));
+    CPPUNIT_ASSERT(receiver->count == 3);
+    channel.close();
+    CPPUNIT_ASSERT(!channel.trySend(5));
+    CPPUNIT_ASSERT(receiver->status() == Overkiz::Coroutine::STOPPED);
+    CPPUNIT_ASSERT(receiver->sum == 7);
+  }
+
+  void budget()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    BulkEvent event;
+    CPPUNIT_ASSERT(!Overkiz::Coroutine::maybeYield());
+    poller->setBudget(Overkiz::Time::Elapsed(), 10);
+    event.send();
+    poller->loop();
+    poller->setBudget(Overkiz::Time::Elapsed(), 0);
+    CPPUNIT_ASSERT(event.yields == 10);
+  }
+
+  void generator()
+  {
+    Overkiz::Generator<int> squares([](Overkiz::Generator<int>& gen)
+    {
+      for(int i = 1; i <= 4; i++)
+      {
+        gen.yield(i * i);
+      }
+    });
+    int sum = 0;
+
+    for(int value : squares)
+    {
+      sum += value;
+    }
+
+    CPPUNIT_ASSERT(sum == 30);
+    CPPUNIT_ASSERT(!squares.hasNext());
+    squares.reset();
+    CPPUNIT_ASSERT(squares.getNext() == 1);
+    CPPUNIT_ASSERT(squares.getNext() == 4);
+    Counted::instances = 0;
+    {
+      Overkiz::Generator<int> endless([](Overkiz::Generator<int>& gen)
+      {
+        Counted counted;
+
+        for(int i = 0;; i++)
+        {
+          gen.yield(i);
+        }
+      });
+      CPPUNIT_ASSERT(endless.getNext() == 0);
+      CPPUNIT_ASSERT(Counted::instances == 1);
+    }
+    CPPUNIT_ASSERT(Counted::instances == 0);
+    {
+      //A body swallowing the stop is released without being resumed again
+      int resumed = 0;
+      Overkiz::Generator<int> stubborn([&resumed](Overkiz::Generator<int>& gen)
+      {
+        for(;;)
+        {
+          try
+          {
+            resumed++;
+            gen.yield(0);
+          }
+          catch(...)
+          {
+          }
+        }
+      });
+      CPPUNIT_ASSERT(stubborn.getNext() == 0);
+      stubborn.reset();
+      CPPUNIT_ASSERT(resumed == 2);
+      CPPUNIT_ASSERT(stubborn.getNext() == 0);
+    }
+  }
+
+  void mutex()
+  {
+    Overkiz::Coroutine::Mutex mutex;
+    std::vector<int> order;
+    Overkiz::Shared::Pointer<LockerCoroutine> first = Overkiz::Shared::Pointer<LockerCoroutine>::create(mutex, order, 1);
+    Overkiz::Shared::Pointer<LockerCoroutine> second = Overkiz::Shared::Pointer<LockerCoroutine>::create(mutex, order, 2);
+    Overkiz::Coroutine::resume(first);
+    Overkiz::Coroutine::resume(second);
+    CPPUNIT_ASSERT(order.size() == 1);
+    CPPUNIT_ASSERT(!mutex.tryLock());
+    //Unlock hands the mutex over to the second coroutine
+    Overkiz::Coroutine::resume(first);
+    CPPUNIT_ASSERT(order.size() == 2 && order[1] == 2);
+    CPPUNIT_ASSERT(!mutex.tryLock());
+    Overkiz::Coroutine::resume(second);
+    CPPUNIT_ASSERT(mutex.tryLock());
+    mutex.unlock();
+    Overkiz::Coroutine::Semaphore semaphore(1);
+    CPPUNIT_ASSERT(semaphore.tryAcquire());
+    CPPUNIT_ASSERT(!semaphore.tryAcquire());
+    semaphore.release();
+    CPPUNIT_ASSERT(semaphore.value() == 1);
+  }
+
+  void deadline()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    StuckEvent event;
+    event.send();
+    poller->loop();
+    CPPUNIT_ASSERT(!event.reached);
+    CPPUNIT_ASSERT(event.unwound);
+    CPPUNIT_ASSERT(event.status() == Overkiz::Task::Status::IDLE);
+    CPPUNIT_ASSERT(!event.isCancelled());
+    CPPUNIT_ASSERT(!event.hasDeadline());
+  }
+
+  void cancelWaiting()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    Overkiz::Coroutine::Mutex mutex;
+    Overkiz::Coroutine::Semaphore semaphore;
+    BlockedEvent locker(mutex, semaphore);
+    //The queued node is unlinked when the deadline unwinds the task
+    mutex.lock();
+    locker.send();
+    poller->loop();
+    CPPUNIT_ASSERT(!locker.acquired && locker.unwound);
+    mutex.unlock();
+    CPPUNIT_ASSERT(mutex.tryLock());
+    mutex.unlock();
+    //The unit handed over to the cancelled task is released again
+    BlockedEvent acquirer(mutex, semaphore);
+    GranterEvent granter(semaphore, acquirer);
+    acquirer.granter = &granter;
+    acquirer.send();
+    poller->loop();
+    CPPUNIT_ASSERT(!acquirer.acquired && acquirer.unwound);
+    CPPUNIT_ASSERT(semaphore.value() == 1);
+  }
+
+  void deleteWaiting()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    IntChannel channel;
+    WaitingEvent *waiting = new WaitingEvent(channel);
+    Counted::instances = 0;
+    waiting->send();
+    poller->runUntil([waiting]()
+    {
+      return waiting->waiting;
+    });
+    CPPUNIT_ASSERT(waiting->status() == Overkiz::Task::Status::PAUSED);
+    CPPUNIT_ASSERT(Counted::instances == 1);
+    //The paused task is unwound, it leaves the queue of the channel
+    delete waiting;
+    CPPUNIT_ASSERT(Counted::instances == 0);
+    Overkiz::Shared::Pointer<ReceiverCoroutine> receiver = Overkiz::Shared::Pointer<ReceiverCoroutine>::create(channel);
+    Overkiz::Coroutine::resume(receiver);
+    CPPUNIT_ASSERT(channel.trySend(1));
+    CPPUNIT_ASSERT(receiver->count == 1);
+    channel.close();
+  }
+
+  void selectShared()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    IntChannel first;
+    IntChannel second;
+    SelectingEvent selecting(first, second);
+    WaitingEvent waiting(second);
+    selecting.send();
+    poller->runUntil([&selecting]()
+    {
+      return selecting.waiting;
+    });
+    waiting.send();
+    poller->runUntil([&waiting]()
+    {
+      return waiting.waiting;
+    });
+    //The select is notified by the second channel, then the first one is ready too
+    CPPUNIT_ASSERT(second.trySend(2));
+    CPPUNIT_ASSERT(first.trySend(1));
+
+    while(poller->runOnce())
+    {
+    }
+
+    CPPUNIT_ASSERT(selecting.index == 1);
+    //No value is left while the receiver waits
+    CPPUNIT_ASSERT(second.empty());
+    CPPUNIT_ASSERT(waiting.status() == Overkiz::Task::Status::PAUSED);
+    second.close();
+
+    while(poller->runOnce())
+    {
+    }
+
+    CPPUNIT_ASSERT(!waiting.received);
+    CPPUNIT_ASSERT(waiting.status() != Overkiz::Task::Status::PAUSED);
+  }
+
+  void realtime()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    RealtimeEvent event;
+    event.send();
+    poller->loop();
+    CPPUNIT_ASSERT(event.runs == 2);
+    CPPUNIT_ASSERT(event.options & Overkiz::Coroutine::PREFAULTED);
+    //The stack is kept between the two launches
+    CPPUNIT_ASSERT(event.frames[0] == event.frames[1]);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CoroutineTest);
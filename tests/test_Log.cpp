@@ -0,0 +1,541 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestFixture.h>
+#include <kizbox/framework/core/Log.h>
+#include <kizbox/framework/core/LogCategory.h>
+#include <kizbox/framework/core/LogQueue.h>
+#include <kizbox/framework/core/LogRecorder.h>
+#include <kizbox/framework/core/LogSink.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+
+class LogTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE(LogTest);
+  CPPUNIT_TEST(binary);
+  CPPUNIT_TEST(sink);
+  CPPUNIT_TEST(reconnect);
+  CPPUNIT_TEST(error);
+  CPPUNIT_TEST(rate);
+  CPPUNIT_TEST(folding);
+  CPPUNIT_TEST(recorder);
+  CPPUNIT_TEST(category);
+  CPPUNIT_TEST(asynchronous);
+  CPPUNIT_TEST(overflow);
+  CPPUNIT_TEST(gate);
+  CPPUNIT_TEST(exit);
+  CPPUNIT_TEST_SUITE_END();
+public:
+  void setUp()
+  {
+    path = "/tmp/test_Log." + std::to_string(getpid());
+    listen();
+    previous = Overkiz::Log::Sink::get().getPath();
+    Overkiz::Log::Sink::get().setPath(path);
+  }
+
+  void tearDown()
+  {
+    Overkiz::Log::Logger::setRateLimit(0);
+    Overkiz::Log::Logger::setFolding(false);
+    Overkiz::Log::Logger::setAsynchronous(false);
+    Overkiz::Log::Sink::get().setPath(previous);
+    Overkiz::Log::Sink::get().setFormat(Overkiz::Log::Sink::RFC3164);
+    close(fd);
+    unlink(path.c_str());
+  }
+
+protected:
+  /**
+   * Bind the socket receiving the messages.
+   */
+  void listen()
+  {
+    unlink(path.c_str());
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    CPPUNIT_ASSERT(bind(fd, (struct sockaddr *) &address, sizeof(address)) == 0);
+
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  }
+
+  /**
+   * Encode and decode a binary record, and format the message as usual.
+   *
+   * @return false if the format is not encoded.
+   */
+  static bool binary(std::string& decoded, std::string& expected, const char *format, ...)
+  {
+    Overkiz::Log::Record record;
+    char buffer[LOG_MAX_MESSAGE_SIZE];
+    va_list arguments;
+    va_start(arguments, format);
+    bool encoded = record.encode(format, arguments);
+    va_end(arguments);
+    decoded = record.decode(buffer, sizeof(buffer));
+
+    va_start(arguments, format);
+    vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    expected = buffer;
+    return encoded;
+  }
+
+  void binary()
+  {
+    std::string decoded, expected;
+    std::string large(600, 'x');
+
+    CPPUNIT_ASSERT(binary(decoded, expected, "%d %5u %-4x|%hhd %hd %ld %lld %c %%", -1, 42u, 255, 1, 2, -3L, 4LL, 'z'));
+    CPPUNIT_ASSERT(decoded == expected);
+
+    CPPUNIT_ASSERT(binary(decoded, expected, "%*d|%-*.*f|%.*s|", 6, 7, 9, 2, 3.14159, 3, "abcdef"));
+    CPPUNIT_ASSERT(decoded == expected);
+
+    CPPUNIT_ASSERT(binary(decoded, expected, "%zu %zd %jd %td %p %Lf %e", (size_t) 10, (ssize_t) -10,
+                          (intmax_t) 11, (ptrdiff_t) -12, &decoded, (long double) 1.5, 2.5e10));
+    CPPUNIT_ASSERT(decoded == expected);
+
+    //The error is captured when the message is encoded
+    errno = EACCES;
+    CPPUNIT_ASSERT(binary(decoded, expected, "open: %m (%s)", "file"));
+    CPPUNIT_ASSERT(decoded == expected);
+    CPPUNIT_ASSERT(decoded.find(strerror(EACCES)) != std::string::npos);
+
+    CPPUNIT_ASSERT(binary(decoded, expected, "%s", nullptr));
+    CPPUNIT_ASSERT(decoded == "(null)");
+
+    //A long string is truncated to the record
+    CPPUNIT_ASSERT(binary(decoded, expected, "%s", large.c_str()));
+    CPPUNIT_ASSERT(decoded == expected);
+    CPPUNIT_ASSERT(binary(decoded, expected, "%d %s", 1, large.c_str()));
+    CPPUNIT_ASSERT(decoded.size() > 400 && expected.compare(0, decoded.size(), decoded) == 0);
+
+    //A string with a precision may end at an unreadable page without terminator
+    size_t page = getpagesize();
+    char *pages = (char *) mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CPPUNIT_ASSERT(pages != MAP_FAILED);
+    CPPUNIT_ASSERT(mprotect(pages + page, page, PROT_NONE) == 0);
+    char *unterminated = pages + page - 8;
+    memcpy(unterminated, "protocol", 8);
+    CPPUNIT_ASSERT(binary(decoded, expected, "trace %.*s|%.4s|%.12s", 8, unterminated, unterminated, "short"));
+    CPPUNIT_ASSERT(decoded == expected && decoded == "trace protocol|prot|short");
+    munmap(pages, 2 * page);
+
+    //Unsupported conversions are formatted by the caller
+    CPPUNIT_ASSERT(!binary(decoded, expected, "%ls", L"wide"));
+    CPPUNIT_ASSERT(!binary(decoded, expected, "%1$d", 1));
+    CPPUNIT_ASSERT(!binary(decoded, expected, "%Lc", 1));
+  }
+
+  std::string receive()
+  {
+    char packet[LOG_MAX_PACKET_SIZE];
+    ssize_t size = recv(fd, packet, sizeof(packet), 0);
+    return size < 0 ? "" : std::string(packet, size);
+  }
+
+  void sink()
+  {
+    Overkiz::Log::Sink& sink = Overkiz::Log::Sink::get();
+    sink.write(LOG_MAKEPRI(LOG_DAEMON, LOG_NOTICE), "plugin", 0, "single");
+    std::string packet = receive();
+    CPPUNIT_ASSERT(packet.compare(0, 4, "<29>") == 0);
+    CPPUNIT_ASSERT(packet.find(" plugin: single") != std::string::npos);
+
+    sink.setFormat(Overkiz::Log::Sink::RFC5424);
+    Overkiz::Log::Sink::Batch batch;
+
+    //Fewer packets than the default max_dgram_qlen of a unix socket
+    for(int i = 0; i < 4; i++)
+    {
+      CPPUNIT_ASSERT(batch.add(LOG_MAKEPRI(LOG_USER, LOG_ERR), i % 2 ? "odd" : nullptr, 0,
+                               std::to_string(i).c_str()));
+    }
+
+    sink.write(batch);
+    CPPUNIT_ASSERT(batch.empty());
+
+    std::string suffix = " " + std::to_string(getpid()) + " - - ";
+
+    for(int i = 0; i < 4; i++)
+    {
+      packet = receive();
+      CPPUNIT_ASSERT(packet.compare(0, 6, "<11>1 ") == 0);
+      CPPUNIT_ASSERT(packet.find(suffix + std::to_string(i)) == packet.size() - suffix.size() -
+                     std::to_string(i).size());
+      CPPUNIT_ASSERT((packet.find(" odd ") != std::string::npos) == (i % 2 == 1));
+    }
+  }
+
+  /**
+   * Find the descriptor connected to a socket.
+   *
+   * @return the descriptor, -1 if none.
+   */
+  static int connected(const std::string& socketPath)
+  {
+    for(int descriptor = 0; descriptor < 1024; descriptor++)
+    {
+      struct sockaddr_un peer;
+      socklen_t size = sizeof(peer);
+
+      if(getpeername(descriptor, (struct sockaddr *) &peer, &size) == 0 && peer.sun_family == AF_UNIX &&
+         socketPath == peer.sun_path)
+      {
+        return descriptor;
+      }
+    }
+
+    return -1;
+  }
+
+  void reconnect()
+  {
+    Overkiz::Log::Sink& sink = Overkiz::Log::Sink::get();
+    sink.write(LOG_MAKEPRI(LOG_DAEMON, LOG_NOTICE), nullptr, 0, "first");
+    CPPUNIT_ASSERT(receive().find(": first") != std::string::npos);
+    int socket = connected(path);
+    CPPUNIT_ASSERT(socket != -1);
+
+    //Other threads may still send on the descriptor, a file opened meanwhile must not get its number
+    sink.setPath(path + ".other");
+    int file = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    sink.setPath(path);
+    sink.write(LOG_MAKEPRI(LOG_DAEMON, LOG_NOTICE), nullptr, 0, "moved");
+    CPPUNIT_ASSERT(receive().find(": moved") != std::string::npos);
+    CPPUNIT_ASSERT(file != socket);
+    CPPUNIT_ASSERT(connected(path) == socket);
+
+    //The daemon is restarted
+    close(fd);
+    listen();
+    sink.write(LOG_MAKEPRI(LOG_DAEMON, LOG_NOTICE), nullptr, 0, "restarted");
+    CPPUNIT_ASSERT(receive().find(": restarted") != std::string::npos);
+    CPPUNIT_ASSERT(connected(path) == socket);
+    close(file);
+  }
+
+  void error()
+  {
+    //Each output formats %m with the errno of the caller, which is kept
+    errno = EACCES;
+    OVK_ERROR("denied: %m");
+    CPPUNIT_ASSERT(errno == EACCES);
+    CPPUNIT_ASSERT(receive().find(": denied: " + std::string(strerror(EACCES))) != std::string::npos);
+
+    //Without daemon, the failed connection must not change the console output
+    Overkiz::Log::Sink::get().setPath(path + ".missing");
+    std::string console;
+    char buffer[256];
+    int pipes[2];
+    CPPUNIT_ASSERT(pipe(pipes) == 0);
+    fflush(stderr);
+    int output = dup(STDERR_FILENO);
+    dup2(pipes[1], STDERR_FILENO);
+    errno = EACCES;
+    OVK_ERROR("denied: %m");
+    int error = errno;
+    fflush(stderr);
+    dup2(output, STDERR_FILENO);
+    close(output);
+    close(pipes[1]);
+    ssize_t size;
+
+    while((size = read(pipes[0], buffer, sizeof(buffer))) > 0)
+    {
+      console.append(buffer, size);
+    }
+
+    close(pipes[0]);
+    CPPUNIT_ASSERT(error == EACCES);
+    CPPUNIT_ASSERT(console.find("denied: " + std::string(strerror(EACCES))) != std::string::npos);
+  }
+
+  void rate()
+  {
+    Overkiz::Log::Logger::setRateLimit(1, 2);
+
+    for(int i = 0; i < 5; i++)
+    {
+      OVK_NOTICE("storm %d", i);
+    }
+
+    CPPUNIT_ASSERT(receive().find(": storm 0") != std::string::npos);
+    CPPUNIT_ASSERT(receive().find(": storm 1") != std::string::npos);
+
+    //Refill one token
+    usleep(1100000);
+    OVK_NOTICE("storm %d", 5);
+    CPPUNIT_ASSERT(receive().find(": Suppressed 3 messages: storm %d") != std::string::npos);
+    CPPUNIT_ASSERT(receive().find(": storm 5") != std::string::npos);
+  }
+
+  static void *repeating(void *argument)
+  {
+    for(int i = 0; i < 3; i++)
+    {
+      OVK_NOTICE("repeated %d", i);
+    }
+
+    return nullptr;
+  }
+
+  void folding()
+  {
+    Overkiz::Log::Logger::setFolding(true, 1);
+
+    //The count is written when the site logs again after the delay
+    for(int i = 0; i < 3; i++)
+    {
+      OVK_NOTICE("folded %d", i);
+    }
+
+    usleep(1100000);
+    OVK_NOTICE("folded %d", 3);
+    CPPUNIT_ASSERT(receive().find(": folded 0") != std::string::npos);
+    CPPUNIT_ASSERT(receive().find(": Last message repeated 2 times.") != std::string::npos);
+    CPPUNIT_ASSERT(receive().find(": folded 3") != std::string::npos);
+
+    //And when the thread exits
+    pthread_t thread;
+    CPPUNIT_ASSERT(pthread_create(&thread, nullptr, &LogTest::repeating, nullptr) == 0);
+    pthread_join(thread, nullptr);
+    CPPUNIT_ASSERT(receive().find(": repeated 0") != std::string::npos);
+    CPPUNIT_ASSERT(receive().find(": Last message repeated 2 times.") != std::string::npos);
+  }
+
+  void recorder()
+  {
+    std::string ring = path + ".ring";
+    std::string text;
+    char buffer[4096];
+    int pipes[2];
+    CPPUNIT_ASSERT(pipe(pipes) == 0);
+
+    {
+      Overkiz::Log::Recorder recorder(ring, 8192);
+      Overkiz::Log::Logger::setRecorder(&recorder);
+
+      //Wrap the ring
+      for(int i = 0; i < 300; i++)
+      {
+        OVK_DEBUG("flight %d", i);
+      }
+
+      Overkiz::Log::Logger::setRecorder(nullptr);
+      recorder.dump(pipes[1]);
+    }
+
+    close(pipes[1]);
+    ssize_t size;
+
+    while((size = read(pipes[0], buffer, sizeof(buffer))) > 0)
+    {
+      text.append(buffer, size);
+    }
+
+    close(pipes[0]);
+    unlink(ring.c_str());
+    CPPUNIT_ASSERT(text.find(" DEBUG flight 0\n") == std::string::npos);
+    CPPUNIT_ASSERT(text.find(" DEBUG flight 298\n") != std::string::npos);
+    CPPUNIT_ASSERT(text.size() > 11 && text.compare(text.size() - 11, 11, "flight 299\n") == 0);
+  }
+
+  void category()
+  {
+    Overkiz::Log::Category category("test");
+    Overkiz::Log::Logger::setLevel(Overkiz::Log::OVK_INFO);
+    CPPUNIT_ASSERT(!category.isEnabled(Overkiz::Log::OVK_DEBUG));
+
+    CPPUNIT_ASSERT(!Overkiz::Log::Category::configure("test=debug other"));
+    CPPUNIT_ASSERT(receive().find(": Log category test set to debug") != std::string::npos);
+    CPPUNIT_ASSERT(category.isEnabled(Overkiz::Log::OVK_DEBUG));
+    //The level replaces the console level too
+    std::string console;
+    char buffer[256];
+    int pipes[2];
+    CPPUNIT_ASSERT(pipe(pipes) == 0);
+    fflush(stdout);
+    int output = dup(STDOUT_FILENO);
+    dup2(pipes[1], STDOUT_FILENO);
+    OVK_DEBUG("hidden");
+    OVK_CDEBUG(category, "shown %d", 1);
+    fflush(stdout);
+    dup2(output, STDOUT_FILENO);
+    close(output);
+    close(pipes[1]);
+    ssize_t size;
+
+    while((size = read(pipes[0], buffer, sizeof(buffer))) > 0)
+    {
+      console.append(buffer, size);
+    }
+
+    close(pipes[0]);
+    CPPUNIT_ASSERT(receive().find(": shown 1") != std::string::npos);
+    CPPUNIT_ASSERT(console.find("shown 1") != std::string::npos);
+    CPPUNIT_ASSERT(console.find("hidden") == std::string::npos);
+
+    //A later category of the same name gets the level
+    Overkiz::Log::Category twin("test");
+    CPPUNIT_ASSERT(twin.getLevel() == Overkiz::Log::OVK_DEBUG);
+
+    Overkiz::Log::Category::setLevel("test", Overkiz::Log::OVK_UNKNOWN_PRIORITY);
+    CPPUNIT_ASSERT(!category.isEnabled(Overkiz::Log::OVK_DEBUG));
+
+    //A category quieter than the thread
+    Overkiz::Log::Logger::setLevel(Overkiz::Log::OVK_DEBUG);
+    Overkiz::Log::Category::setLevel("test", Overkiz::Log::OVK_WARNING);
+    CPPUNIT_ASSERT(!category.isEnabled(Overkiz::Log::OVK_NOTICE));
+    category.print(Overkiz::Log::OVK_NOTICE, "quiet %d", 2);
+    OVK_NOTICE("loud %d", 3);
+    CPPUNIT_ASSERT(receive().find(": loud 3") != std::string::npos);
+    Overkiz::Log::Category::setLevel("test", Overkiz::Log::OVK_UNKNOWN_PRIORITY);
+  }
+
+  void asynchronous()
+  {
+    //Never enabled, nothing to flush
+    Overkiz::Log::Logger::setAsynchronous(false);
+    CPPUNIT_ASSERT(!Overkiz::Log::Drain::current());
+
+    //More messages than the ring holds, the logger waits for the drain
+    Overkiz::Log::Logger::setAsynchronous(true, Overkiz::Log::OVK_OVERFLOW_BLOCK, 2);
+
+    for(int i = 0; i < 8; i++)
+    {
+      OVK_NOTICE("ordered %d", i);
+    }
+
+    Overkiz::Log::Logger::flush();
+
+    for(int i = 0; i < 8; i++)
+    {
+      CPPUNIT_ASSERT(receive().find(": ordered " + std::to_string(i)) != std::string::npos);
+    }
+  }
+
+  static void *overflowing(void *argument)
+  {
+    OVK_NOTICE("overflow %d", 0);
+    usleep(5000);
+
+    //The drain waits in its first send, the second message fits in the ring, the next ones are dropped
+    for(int i = 1; i < 5; i++)
+    {
+      OVK_NOTICE("overflow %d", i);
+    }
+
+    return nullptr;
+  }
+
+  void overflow()
+  {
+    //Fill the queue of the socket
+    int client = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    int filled = 0;
+
+    while(sendto(client, "filler", 6, 0, (struct sockaddr *) &address, sizeof(address)) == 6)
+    {
+      filled++;
+    }
+
+    close(client);
+
+    //The ring is created by the first message of a thread, with the current capacity
+    Overkiz::Log::Logger::setAsynchronous(true, Overkiz::Log::OVK_OVERFLOW_DROP, 1);
+    pthread_t thread;
+    CPPUNIT_ASSERT(pthread_create(&thread, nullptr, &LogTest::overflowing, nullptr) == 0);
+    pthread_join(thread, nullptr);
+
+    for(int i = 0; i < filled; i++)
+    {
+      CPPUNIT_ASSERT(receive() == "filler");
+    }
+
+    Overkiz::Log::Logger::flush();
+    CPPUNIT_ASSERT(receive().find(": overflow 0") != std::string::npos);
+    CPPUNIT_ASSERT(receive().find(": overflow 1") != std::string::npos);
+    CPPUNIT_ASSERT(receive().find(": 3 log messages dropped.") != std::string::npos);
+  }
+
+  void gate()
+  {
+    //The arguments of a discarded message are not evaluated
+    int evaluated = 0;
+    Overkiz::Log::Logger::setLevel(Overkiz::Log::OVK_INFO);
+    CPPUNIT_ASSERT(!Overkiz::Log::Logger::isEnabled(Overkiz::Log::OVK_DEBUG));
+    CPPUNIT_ASSERT(Overkiz::Log::Logger::isEnabled(Overkiz::Log::OVK_INFO));
+    OVK_DEBUG("discarded %d", ++evaluated);
+    CPPUNIT_ASSERT(evaluated == 0);
+    OVK_INFO("logged %d", ++evaluated);
+    CPPUNIT_ASSERT(evaluated == 1);
+    CPPUNIT_ASSERT(receive().find(": logged 1") != std::string::npos);
+
+    //A print level lets its messages through, even below the syslog level
+    Overkiz::Log::Logger::setLevel(Overkiz::Log::OVK_ERROR);
+    CPPUNIT_ASSERT(!Overkiz::Log::Logger::isEnabled(Overkiz::Log::OVK_WARNING));
+    Overkiz::Log::Priority print = Overkiz::Log::Logger::get()->getPrintLevel();
+    Overkiz::Log::Logger::get()->setPrintLevel(Overkiz::Log::OVK_WARNING);
+    CPPUNIT_ASSERT(Overkiz::Log::Logger::isEnabled(Overkiz::Log::OVK_WARNING));
+    CPPUNIT_ASSERT(!Overkiz::Log::Logger::isEnabled(Overkiz::Log::OVK_NOTICE));
+    OVK_NOTICE("discarded %d", ++evaluated);
+    CPPUNIT_ASSERT(evaluated == 1);
+    Overkiz::Log::Logger::get()->setPrintLevel(print);
+    Overkiz::Log::Logger::setLevel(Overkiz::Log::OVK_DEBUG);
+    CPPUNIT_ASSERT(Overkiz::Log::Logger::isEnabled(Overkiz::Log::OVK_DEBUG));
+  }
+
+  static void *logging(void *argument)
+  {
+    for(int i = 0; i < 4; i++)
+    {
+      OVK_NOTICE("exiting %d", i);
+    }
+
+    return nullptr;
+  }
+
+  void exit()
+  {
+    Overkiz::Log::Logger::setAsynchronous(true, Overkiz::Log::OVK_OVERFLOW_BLOCK, 16);
+    pthread_t thread;
+    CPPUNIT_ASSERT(pthread_create(&thread, nullptr, &LogTest::logging, nullptr) == 0);
+    pthread_join(thread, nullptr);
+
+    //The ring of the thread is closed, the queued messages are still written
+    for(int i = 0; i < 4; i++)
+    {
+      CPPUNIT_ASSERT(receive().find(": exiting " + std::to_string(i)) != std::string::npos);
+    }
+
+    //The drain is woken up to delete the closed ring, the other threads still log
+    Overkiz::Log::Logger::flush();
+    OVK_NOTICE("after %d", 0);
+    Overkiz::Log::Logger::flush();
+    CPPUNIT_ASSERT(receive().find(": after 0") != std::string::npos);
+  }
+
+  std::string path;
+  std::string previous;
+  int fd;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LogTest);
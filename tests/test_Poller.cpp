@@ -0,0 +1,426 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestFixture.h>
+#include <kizbox/framework/core/Poller.h>
+#include <kizbox/framework/core/Profiler.h>
+#include <kizbox/framework/core/Synchronization.h>
+#include <kizbox/framework/core/Timer.h>
+#include <kizbox/framework/core/Watchdog.h>
+#include <kizbox/framework/core/Watcher.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static long threadId()
+{
+  return syscall(SYS_gettid);
+}
+
+static std::atomic<int> finished(0);
+
+class MigratedTimer : public Overkiz::Timer::Monotonic
+{
+public:
+  MigratedTimer() :
+    Overkiz::Timer::Monotonic(false), first(0), last(0)
+  {
+  }
+
+  void expired(const Overkiz::Time::Monotonic& time)
+  {
+    first = threadId();
+
+    while(!Overkiz::Coroutine::maybeYield())
+    {
+    }
+
+    last = threadId();
+    finished++;
+  }
+
+  long first;
+  long last;
+};
+
+class MoverTimer : public Overkiz::Timer::Monotonic
+{
+public:
+  MoverTimer(MigratedTimer& timer, Overkiz::Poller& target) :
+    Overkiz::Timer::Monotonic(false), timer(timer), target(target)
+  {
+  }
+
+  void expired(const Overkiz::Time::Monotonic& time)
+  {
+    Overkiz::Poller::get()->migrate(&timer, target);
+    Overkiz::Poller::get()->stop();
+  }
+
+  MigratedTimer& timer;
+  Overkiz::Poller& target;
+};
+
+class WaitTimer : public Overkiz::Timer::Monotonic
+{
+public:
+  WaitTimer() :
+    Overkiz::Timer::Monotonic(Overkiz::Time::Elapsed(0, 1000000), true)
+  {
+  }
+
+  void expired(const Overkiz::Time::Monotonic& time)
+  {
+    if(finished)
+    {
+      Overkiz::Poller::get()->stop();
+    }
+    else
+    {
+      start();
+    }
+  }
+};
+
+class TickTimer : public Overkiz::Timer::Monotonic
+{
+public:
+  TickTimer() :
+    Overkiz::Timer::Monotonic(Overkiz::Time::Elapsed(0, 5000000), true), ticks(0)
+  {
+  }
+
+  void expired(const Overkiz::Time::Monotonic& time)
+  {
+    ticks++;
+    start();
+  }
+
+  int ticks;
+};
+
+class BlockingTimer : public Overkiz::Timer::Monotonic
+{
+public:
+  BlockingTimer() :
+    Overkiz::Timer::Monotonic(Overkiz::Time::Elapsed(0, 1000000), true)
+  {
+  }
+
+  void expired(const Overkiz::Time::Monotonic& time)
+  {
+    Overkiz::Time::Monotonic end = Overkiz::Time::Monotonic::now() + Overkiz::Time::Elapsed(0, 300000000);
+
+    //Busy loop, a sleep would be interrupted by the watchdog
+    while(Overkiz::Time::Monotonic::now() < end)
+    {
+    }
+
+    Overkiz::Poller::get()->stop();
+  }
+};
+
+class WatchdogDelegate : public Overkiz::Poller::Watchdog::Delegate
+{
+public:
+  WatchdogDelegate() :
+    reports(0), task(nullptr), depth(0)
+  {
+  }
+
+  void blocked(const Overkiz::Poller::Watchdog::Report& report)
+  {
+    task = report.task;
+    depth = report.depth;
+    reports++;
+  }
+
+  std::atomic<int> reports;
+  Overkiz::Task *task;
+  int depth;
+};
+
+class OrderedWatcher : public Overkiz::Watcher
+{
+public:
+  OrderedWatcher(std::vector<int>& order, int priority) :
+    Overkiz::Watcher(eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC), EPOLLIN), order(order)
+  {
+    setPriority(priority);
+    start();
+  }
+
+  void process(uint32_t events)
+  {
+    uint64_t value;
+
+    if(read(fd, &value, sizeof(value)) == sizeof(value))
+    {
+      order.push_back(getPriority());
+    }
+
+    if(order.size() == 3)
+    {
+      Overkiz::Poller::get()->stop();
+    }
+  }
+
+  std::vector<int>& order;
+};
+
+class PausingWatcher : public Overkiz::Watcher
+{
+public:
+  PausingWatcher(Overkiz::Coroutine::Semaphore& semaphore) :
+    Overkiz::Watcher(eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC), EPOLLIN), semaphore(semaphore), done(false)
+  {
+    start();
+  }
+
+  void process(uint32_t events)
+  {
+    uint64_t value;
+    Overkiz::Time::Elapsed busy = { 0, 2000000 };
+    Overkiz::Time::Monotonic end = Overkiz::Time::Monotonic::now() + busy;
+
+    if(read(fd, &value, sizeof(value)) == sizeof(value))
+    {
+      while(Overkiz::Time::Monotonic::now() < end)
+      {
+      }
+
+      semaphore.acquire();
+      done = true;
+    }
+  }
+
+  Overkiz::Coroutine::Semaphore& semaphore;
+  bool done;
+};
+
+class RecordingCallback : public Overkiz::Poller::Callback
+{
+public:
+  RecordingCallback(std::string& trace, char name, RecordingCallback *then = nullptr) :
+    trace(trace), name(name), then(then)
+  {
+  }
+
+  void run()
+  {
+    trace += name;
+
+    if(then)
+    {
+      Overkiz::Poller::get()->defer(*then);
+    }
+  }
+
+  std::string& trace;
+  char name;
+  RecordingCallback *then;
+};
+
+class PollerTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE(PollerTest);
+  CPPUNIT_TEST(migrate);
+  CPPUNIT_TEST(watchdog);
+  CPPUNIT_TEST(profiler);
+  CPPUNIT_TEST(priority);
+  CPPUNIT_TEST(callbacks);
+  CPPUNIT_TEST(bounded);
+  CPPUNIT_TEST(snapshot);
+  CPPUNIT_TEST_SUITE_END();
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+protected:
+  void migrate()
+  {
+    std::atomic<Overkiz::Poller *> target(nullptr);
+    long targetId = 0;
+    std::thread thread([&]()
+    {
+      WaitTimer wait;
+      wait.start();
+      targetId = threadId();
+      target = &*Overkiz::Poller::get(true, false);
+      Overkiz::Poller::get()->loop();
+    });
+
+    while(!target)
+    {
+      usleep(1000);
+    }
+
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    poller->setBudget(Overkiz::Time::Elapsed(), 1);
+    MigratedTimer timer;
+    MoverTimer mover(timer, *target);
+    Overkiz::Time::Monotonic now = Overkiz::Time::Monotonic::now();
+    timer.setTime(now);
+    mover.setTime(now);
+    timer.start();
+    mover.start();
+    poller->loop();
+    thread.join();
+    poller->setBudget(Overkiz::Time::Elapsed(), 0);
+    CPPUNIT_ASSERT(finished == 1);
+    CPPUNIT_ASSERT(timer.first == threadId());
+    CPPUNIT_ASSERT(timer.last == targetId);
+  }
+
+  void watchdog()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    WatchdogDelegate delegate;
+    Overkiz::Poller::Watchdog watchdog(Overkiz::Time::Elapsed(0, 50000000), &delegate);
+    BlockingTimer timer;
+    timer.start();
+    poller->loop();
+    CPPUNIT_ASSERT(delegate.reports == 1);
+    CPPUNIT_ASSERT(delegate.task == &timer);
+    CPPUNIT_ASSERT(delegate.depth > 1);
+  }
+
+  void profiler()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    Overkiz::Profiler profiler(1000);
+    BlockingTimer timer;
+    timer.start();
+    profiler.start();
+    poller->loop();
+    profiler.stop();
+    std::map<std::string, size_t> types = profiler.types();
+    CPPUNIT_ASSERT(profiler.samples() > 0);
+    CPPUNIT_ASSERT(types["BlockingTimer"] > profiler.samples() / 2);
+    //A SIGPROF still pending when the profiler stops doesn't reach the default action
+    sigset_t blocked, saved;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &blocked, &saved);
+    profiler.start();
+    pthread_kill(pthread_self(), SIGPROF);
+    profiler.stop();
+    pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+  }
+
+  void priority()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    std::vector<int> order;
+    OrderedWatcher low(order, -1);
+    OrderedWatcher normal(order, 0);
+    OrderedWatcher urgent(order, 2);
+    poller->setRepoll(true);
+    poller->loop();
+    poller->setRepoll(false);
+    CPPUNIT_ASSERT(order.size() == 3);
+    CPPUNIT_ASSERT(order[0] == 2 && order[1] == 0 && order[2] == -1);
+  }
+
+  void callbacks()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    std::string trace;
+    RecordingCallback idle(trace, 'i');
+    RecordingCallback second(trace, 's');
+    RecordingCallback first(trace, 'f', &second);
+    RecordingCallback cancelled(trace, 'c');
+    poller->idle(idle);
+    poller->defer(first);
+    poller->defer(cancelled);
+    cancelled.cancel();
+    poller->loop();
+    CPPUNIT_ASSERT(trace == "fsi");
+    CPPUNIT_ASSERT(!idle.isQueued() && !cancelled.isQueued());
+  }
+
+  void bounded()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    std::string trace;
+    RecordingCallback second(trace, 's');
+    RecordingCallback first(trace, 'f', &second);
+    poller->defer(first);
+    CPPUNIT_ASSERT(poller->runOnce());
+    CPPUNIT_ASSERT(trace == "f");
+    //The callback left queued makes the epoll fd readable
+    struct pollfd ready = { poller->getFd(), POLLIN, 0 };
+    CPPUNIT_ASSERT(poll(&ready, 1, 0) == 1);
+    CPPUNIT_ASSERT(poller->runOnce());
+    CPPUNIT_ASSERT(trace == "fs");
+
+    TickTimer timer;
+    timer.start();
+    Overkiz::Time::Monotonic start = Overkiz::Time::Monotonic::now();
+    poller->runFor(Overkiz::Time::Elapsed(0, 50000000));
+    Overkiz::Time::Elapsed elapsed = Overkiz::Time::Monotonic::now() - start;
+    CPPUNIT_ASSERT(elapsed.seconds == 0 && elapsed.nanoseconds >= 50000000);
+    CPPUNIT_ASSERT(timer.ticks >= 2);
+
+    int ticks = timer.ticks;
+    poller->runUntil([&]() { return timer.ticks == ticks + 3; });
+    CPPUNIT_ASSERT(timer.ticks == ticks + 3);
+  }
+
+  void snapshot()
+  {
+    Overkiz::Shared::Pointer<Overkiz::Poller>& poller = Overkiz::Poller::get(true, false);
+    TickTimer timer;
+    timer.start();
+    poller->runUntil([&]() { return timer.ticks == 3; });
+    std::vector<Overkiz::Poller::Registration> registrations = poller->snapshot();
+    const Overkiz::Poller::Registration *manager = nullptr;
+
+    for(auto& registration : registrations)
+    {
+      if(registration.type == "Overkiz::Timer::Monotonic::Manager")
+      {
+        manager = &registration;
+      }
+    }
+
+    CPPUNIT_ASSERT(manager);
+    CPPUNIT_ASSERT(manager->clients == 1);
+    CPPUNIT_ASSERT(manager->dispatches >= 3);
+    CPPUNIT_ASSERT(manager->status == Overkiz::Task::Status::IDLE);
+    CPPUNIT_ASSERT(manager->polled);
+    //A paused watcher is still registered, out of the epoll set, and its dispatch is timed
+    Overkiz::Coroutine::Semaphore semaphore;
+    PausingWatcher paused(semaphore);
+    poller->runUntil([&]() { return paused.status() == Overkiz::Task::Status::PAUSED; });
+    registrations = poller->snapshot();
+    const Overkiz::Poller::Registration *found = nullptr;
+
+    for(auto& registration : registrations)
+    {
+      if(registration.watcher == &paused)
+      {
+        found = &registration;
+      }
+    }
+
+    CPPUNIT_ASSERT(found);
+    CPPUNIT_ASSERT(found->status == Overkiz::Task::Status::PAUSED);
+    CPPUNIT_ASSERT(!found->polled);
+    CPPUNIT_ASSERT(found->dispatches == 1);
+    CPPUNIT_ASSERT(found->time.seconds > 0 || found->time.nanoseconds >= 2000000);
+    CPPUNIT_ASSERT(found->toString().find("status=paused polled=no") != std::string::npos);
+    semaphore.release();
+    poller->runUntil([&]() { return paused.done; });
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(PollerTest);
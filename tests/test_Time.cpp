@@ -1,11 +1,14 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/TestFixture.h>
+#include <kizbox/framework/core/Clock.h>
 #include <kizbox/framework/core/Time.h>
+#include <unistd.h>
 
 class TimeTest : public CppUnit::TestFixture
 {
   CPPUNIT_TEST_SUITE(TimeTest);
   CPPUNIT_TEST(compare);
+  CPPUNIT_TEST(clock);
   CPPUNIT_TEST_SUITE_END();
 public:
   void setUp()
@@ -17,6 +20,12 @@ public:
   }
 
 protected:
+  static long nanoseconds(const Overkiz::Time::Monotonic& time)
+  {
+    Overkiz::Time::Elapsed elapsed = time;
+    return elapsed.seconds * 1000000000L + elapsed.nanoseconds;
+  }
+
   void compare()
   {
     Overkiz::Time::Real t1;
@@ -25,6 +34,29 @@ protected:
     t2 = Overkiz::Time::Real::now();
     CPPUNIT_ASSERT(t1 < t2);
   }
+
+  void clock()
+  {
+    Overkiz::Time::Monotonic t1 = Overkiz::Time::Monotonic::cached();
+    usleep(1000);
+    CPPUNIT_ASSERT(t1 < Overkiz::Time::Monotonic::cached());
+
+    Overkiz::Time::Clock::tick();
+    t1 = Overkiz::Time::Monotonic::cached();
+    usleep(1000);
+    CPPUNIT_ASSERT(t1 == Overkiz::Time::Monotonic::cached());
+    Overkiz::Time::Clock::release();
+
+    //The counter is optional, its durations must match the monotonic clock
+    Overkiz::Time::Clock::setCounter(true);
+    Overkiz::Time::Monotonic f1 = Overkiz::Time::Monotonic::fast();
+    t1 = Overkiz::Time::Monotonic::now();
+    usleep(100000);
+    Overkiz::Time::Monotonic f2 = Overkiz::Time::Monotonic::fast();
+    Overkiz::Time::Monotonic t2 = Overkiz::Time::Monotonic::now();
+    Overkiz::Time::Clock::setCounter(false);
+    CPPUNIT_ASSERT(labs(nanoseconds(f2 - f1) - nanoseconds(t2 - t1)) < 1000000);
+  }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TimeTest);
\ No newline at end of file
@@ -0,0 +1,35 @@
+/*
+ * LogRecorder.cpp
+ *
+ *      Copyright (C) 2015 Overkiz SA.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <kizbox/framework/core/LogRecorder.h>
+
+/**
+ * Print the messages of flight recorder ring files, oldest first.
+ */
+int main(int argc, char **argv)
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "Usage: %s FILE...\n", argv[0]);
+    return 2;
+  }
+
+  int status = 0;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(!Overkiz::Log::Recorder::dump(argv[i], STDOUT_FILENO))
+    {
+      fprintf(stderr, "%s: %s is not a log recorder file.\n", argv[0], argv[i]);
+      status = 1;
+    }
+  }
+
+  return status;
+}